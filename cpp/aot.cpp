@@ -0,0 +1,422 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#include "eltab.h"
+#include "aot.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ctor, the hash starts with the size of the table
+FormulaHash::FormulaHash(const short rows, const short cols) :
+    m_hash(14695981039346656037ull) { // FNV-1a
+    add(&AOT_VERSION, sizeof(AOT_VERSION));
+    add(&rows, sizeof(rows));
+    add(&cols, sizeof(cols));
+}
+
+void FormulaHash::add(const void *data, const size_t size) {
+    const unsigned char *p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        m_hash = (m_hash ^ p[i]) * 1099511628211ull;
+    }
+}
+
+// adds the expression of the cell with the given index
+void FormulaHash::add(const int idx, const string &text) {
+    add(&idx, sizeof(idx));
+    add(text.data(), text.size() + 1); // with terminating zero
+}
+
+// hash as hexadecimal string
+string FormulaHash::to_string() const {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx",
+        static_cast<unsigned long long>(m_hash));
+    return buf;
+}
+
+AotLibrary::~AotLibrary() {
+    if (m_handle == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    FreeLibrary(static_cast<HMODULE>(m_handle));
+#else
+    dlclose(m_handle);
+#endif
+}
+
+// loads the library, returns false if there is no usable one
+bool AotLibrary::load(const string &path) {
+    typedef int (*version_t)();
+    version_t version;
+#ifdef _WIN32
+    HMODULE handle = LoadLibraryA(path.c_str());
+    if (handle == nullptr) {
+        return false;
+    }
+    m_handle = handle;
+    version = reinterpret_cast<version_t>(
+        GetProcAddress(handle, "eltab_version"));
+    m_eval = reinterpret_cast<eval_t>(GetProcAddress(handle, "eltab_eval"));
+    m_inputs = reinterpret_cast<inputs_t>(
+        GetProcAddress(handle, "eltab_inputs"));
+#else
+    m_handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (m_handle == nullptr) {
+        return false;
+    }
+    version = reinterpret_cast<version_t>(dlsym(m_handle, "eltab_version"));
+    m_eval = reinterpret_cast<eval_t>(dlsym(m_handle, "eltab_eval"));
+    m_inputs = reinterpret_cast<inputs_t>(dlsym(m_handle, "eltab_inputs"));
+#endif
+    return version != nullptr && version() == AOT_VERSION &&
+        m_eval != nullptr && m_inputs != nullptr;
+}
+
+// cells which are not expressions read by the expressions
+vector<int> AotLibrary::get_inputs() const {
+    int count = 0;
+    const int *inputs = m_inputs(&count);
+    return vector<int>(inputs, inputs + count);
+}
+
+// creates the directory if there is no such one
+static bool make_dir(const string &path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+#endif
+}
+
+// path of the compiled sheet with the given hash in the cache directory
+string get_cache_path(const string &hash) {
+    string dir;
+    const char *env = getenv("ELTAB_CACHE");
+    if (env != nullptr && *env != '\0') {
+        dir = env;
+    }
+    else {
+#ifdef _WIN32
+        env = getenv("LOCALAPPDATA");
+        if (env == nullptr) {
+            return string();
+        }
+        dir = string(env) + "\\eltab";
+#else
+        env = getenv("XDG_CACHE_HOME");
+        if (env != nullptr && *env != '\0') {
+            dir = env;
+        }
+        else if ((env = getenv("HOME")) != nullptr) {
+            dir = string(env) + "/.cache";
+            make_dir(dir);
+        }
+        else {
+            return string();
+        }
+        dir += "/eltab";
+#endif
+    }
+    if (!make_dir(dir)) {
+        return string();
+    }
+
+#ifdef _WIN32
+    return dir + "\\sheet-" + hash + ".dll";
+#else
+    return dir + "/sheet-" + hash + ".so";
+#endif
+}
+
+// compiles the source into the shared library at the path, the library
+// is built under a temporary name and then renamed, so the other runs
+// never load the library being built
+bool build_library(const string &source, const string &path) {
+#ifdef _WIN32
+    string tmp = path + "." + to_string(_getpid());
+    string src = tmp + ".cpp";
+    string bin = tmp + ".tmp.dll";
+    string dir = path.substr(0, path.find_last_of('\\') + 1);
+    string cmd = "cl /nologo /O2 /LD /Fe\"" + bin + "\" /Fo\"" + dir +
+        "\\\" \"" + src + "\" > nul 2>&1";
+#else
+    string tmp = path + "." + to_string(getpid());
+    string src = tmp + ".cpp";
+    string bin = tmp + ".tmp";
+    const char *cxx = getenv("CXX");
+    string cmd = string((cxx != nullptr && *cxx != '\0') ? cxx : "c++") +
+        " -std=c++11 -O2 -shared -fPIC -o \"" + bin + "\" \"" + src +
+        "\" > /dev/null 2>&1";
+#endif
+
+    FILE *f = fopen(src.c_str(), "wb");
+    if (f == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(source.data(), 1, source.size(), f) == source.size();
+    ok = (fclose(f) == 0) && ok;
+
+    ok = ok && system(cmd.c_str()) == 0;
+    ok = ok && rename(bin.c_str(), path.c_str()) == 0;
+
+    remove(src.c_str());
+    if (!ok) {
+        remove(bin.c_str());
+    }
+    return ok;
+}
+
+// writes out the array of ints
+static void write_array(ostringstream &src, const string &name,
+    const vector<int> &values) {
+    src << "static const int " << name << "[] = {";
+    for (size_t i = 0; i < values.size(); i++) {
+        src << ((i % 16 == 0) ? "\n    " : " ") << values[i] << ",";
+    }
+    src << "\n};\n";
+}
+
+// Generates the C++ source of the shared library evaluating the table
+// the way run() does. Each shape gets the straight-line function doing
+// what execute() does with its program, the expressions are evaluated
+// level by level (as by run_levels()), the ones of the same level and
+// shape by one loop. The cells in cycles get #E_CROSS_REF.
+// The library is valid while the expressions don't change and the cells
+// they reference are not malformed, it gets the values of these cells
+// and gives the values of the expressions (see AotValue). The source is
+// empty if some of the referenced cells is malformed now, as the order
+// of evaluation depends on it.
+// The code is generated for each expression which is not in a cycle
+// (marked by run()) and the levels are worked out here from the
+// references: the values of the cells may differ when the library is
+// used, so it doesn't depend on the order of this run, which leaves out
+// the expressions evaluated by the column kernel or on demand.
+string Tokenizer::generate_source() const {
+    for (auto &stop : m_stops) {
+        if (stop.first >= 0) {
+            return string();
+        }
+    }
+
+    ostringstream src;
+    src << "// sheet compiled by eltab --compile\n"
+        "#include <cmath>\n\n"
+        "#ifdef _WIN32\n"
+        "#define EXPORT extern \"C\" __declspec(dllexport)\n"
+        "#else\n"
+        "#define EXPORT extern \"C\" __attribute__((visibility(\"default\")))\n"
+        "#endif\n\n"
+        "struct AotValue { int tag; int aux; double num; };\n\n"
+        "static inline AotValue ev_value(const int tag, const int aux,\n"
+        "    const double num) {\n"
+        "    AotValue v = { tag, aux, num };\n"
+        "    return v;\n"
+        "}\n\n"
+        "static inline bool ev_oper(AotValue &l, const AotValue &r,\n"
+        "    const int op) {\n"
+        "    if (l.tag != " << Token::T_NUMBER << " || r.tag != "
+        << Token::T_NUMBER << ") {\n"
+        "        l = ev_value(" << Token::T_ERROR << ", " << E_UNEXP_EXPR
+        << ", 0);\n"
+        "        return false;\n"
+        "    }\n"
+        "    double v = l.num;\n"
+        "    switch (op) {\n"
+        "    case " << OP_ADD << ": v += r.num; break;\n"
+        "    case " << OP_SUB << ": v -= r.num; break;\n"
+        "    case " << OP_MUL << ": v *= r.num; break;\n"
+        "    default: v /= r.num;\n"
+        "        if (std::isinf(v)) {\n"
+        "            l = ev_value(" << Token::T_ERROR << ", " << E_INFINITE
+        << ", 0);\n"
+        "            return false;\n"
+        "        }\n"
+        "    }\n"
+        "    // out of range and NaN give INT_MIN as the conversion on x86,\n"
+        "    // the compiler must not fold them any other way\n"
+        "    l.num = (v > -2147483649.0 && v < 2147483648.0) ?\n"
+        "        static_cast<int>(v) : -2147483647.0 - 1;\n"
+        "    return true;\n"
+        "}\n\n";
+
+    // shapes of the cells
+    vector<int> shapes(m_cells.size(), -1);
+    for (auto &ex : m_expressions) {
+        shapes[get_index(ex.m_coords)] = ex.m_shape;
+    }
+
+    // levels of the expressions, one more than the highest level of the
+    // expressions they reference, 0 if not known yet, -1 in progress;
+    // the expressions of the same level and shape are grouped
+    vector<int> levels(m_cells.size(), 0);
+    vector<pair<pair<int, int>, int>> cells;
+    vector<pair<int, const int*>> stack; // cell and its next reference
+    auto is_ordered = [&](const int idx) {
+        return m_programs[idx] != nullptr && !is_cross_ref(idx);
+    };
+    for (auto &ex : m_expressions) {
+        int root = static_cast<int>(get_index(ex.m_coords));
+        if (!is_ordered(root) || levels[root] != 0) {
+            continue;
+        }
+        levels[root] = -1;
+        stack.push_back(make_pair(root, m_graph.deps_begin(root)));
+        while (!stack.empty()) {
+            int idx = stack.back().first;
+            const int *&dep = stack.back().second;
+            while (dep < m_graph.deps_end(idx) &&
+                (!is_ordered(*dep) || levels[*dep] > 0)) {
+                ++dep;
+            }
+            if (dep < m_graph.deps_end(idx)) {
+                int next = *dep;
+                if (levels[next] < 0) {
+                    return string(); // cycle left unmarked
+                }
+                levels[next] = -1;
+                stack.push_back(make_pair(next, m_graph.deps_begin(next)));
+                continue;
+            }
+            int level = 0;
+            for (dep = m_graph.deps_begin(idx); dep < m_graph.deps_end(idx);
+                ++dep) {
+                if (is_ordered(*dep)) {
+                    level = max(level, levels[*dep]);
+                }
+            }
+            levels[idx] = level + 1;
+            cells.push_back(make_pair(make_pair(level + 1, shapes[idx]), idx));
+            stack.pop_back();
+        }
+    }
+    std::sort(cells.begin(), cells.end());
+
+    vector<bool> used(m_shapes.size(), false);
+    for (auto &cell : cells) {
+        used[cell.first.second] = true;
+    }
+    for (size_t s = 0; s < used.size(); s++) {
+        if (!used[s]) {
+            continue;
+        }
+        src << "static void shape_" << s
+            << "(AotValue *c, const int base) {\n"
+            "    AotValue s[2];\n";
+        int sp = 0;
+        bool done = false;
+        for (const Instr &in : m_shapes.get(static_cast<int>(s)).m_code) {
+            switch (in.code) {
+            case Instr::I_NUM:
+                src << "    s[" << sp++ << "] = ev_value(" << Token::T_NUMBER
+                    << ", 0, " << in.arg << ");\n";
+                break;
+            case Instr::I_REF:
+                src << "    s[" << sp++ << "] = c[base + " << in.arg
+                    << "];\n";
+                break;
+            case Instr::I_TOUCH:
+                break;
+            case Instr::I_OPER:
+                src << "    if (!ev_oper(s[0], s[1], " << in.arg << ")) {\n"
+                    "        c[base] = s[0];\n"
+                    "        return;\n"
+                    "    }\n";
+                sp = 1;
+                break;
+            case Instr::I_ERROR:
+                src << "    c[base] = ev_value(" << Token::T_ERROR << ", "
+                    << in.arg << ", 0);\n";
+                done = true;
+                break;
+            case Instr::I_RESULT:
+                src << "    c[base] = c[base + " << in.arg << "];\n";
+                done = true;
+                break;
+            }
+            if (done) {
+                break;
+            }
+        }
+        if (!done) {
+            if (sp == 1) {
+                src << "    c[base] = s[0];\n";
+            }
+            else {
+                src << "    c[base] = ev_value(" << Token::T_UNDEFINED
+                    << ", 0, 0);\n";
+            }
+        }
+        src << "}\n\n";
+    }
+
+    vector<pair<int, size_t>> groups; // shape and size of each group
+    vector<int> group;
+    for (size_t i = 0; i < cells.size(); i++) {
+        group.push_back(cells[i].second);
+        if (i + 1 == cells.size() || cells[i + 1].first != cells[i].first) {
+            write_array(src, "group_" + std::to_string(groups.size()), group);
+            groups.push_back(make_pair(cells[i].first.second, group.size()));
+            group.clear();
+        }
+    }
+
+    vector<int> cross;
+    vector<int> inputs;
+    vector<bool> is_input(m_cells.size(), false);
+    for (auto &ex : m_expressions) {
+        int idx = static_cast<int>(get_index(ex.m_coords));
+        if (is_cross_ref(idx)) {
+            cross.push_back(idx);
+        }
+        for (const int *dep = m_graph.deps_begin(idx);
+            dep < m_graph.deps_end(idx); ++dep) {
+            if (m_programs[*dep] == nullptr && !is_input[*dep]) {
+                is_input[*dep] = true;
+                inputs.push_back(*dep);
+            }
+        }
+    }
+    if (!cross.empty()) {
+        write_array(src, "cross", cross);
+    }
+    if (!inputs.empty()) {
+        write_array(src, "inputs", inputs);
+    }
+
+    src << "\nEXPORT int eltab_version() {\n"
+        "    return " << AOT_VERSION << ";\n"
+        "}\n\n"
+        "EXPORT const int* eltab_inputs(int *count) {\n"
+        "    *count = " << inputs.size() << ";\n"
+        "    return " << (inputs.empty() ? "0" : "inputs") << ";\n"
+        "}\n\n"
+        "EXPORT void eltab_eval(AotValue *c) {\n";
+    if (!cross.empty()) {
+        src << "    for (int i = 0; i < " << cross.size() << "; i++) {\n"
+            "        c[cross[i]] = ev_value(" << Token::T_ERROR << ", "
+            << E_CROSS_REF << ", 0);\n"
+            "    }\n";
+    }
+    for (size_t g = 0; g < groups.size(); g++) {
+        src << "    for (int i = 0; i < " << groups[g].second << "; i++) {\n"
+            "        shape_" << groups[g].first << "(c, group_" << g
+            << "[i]);\n"
+            "    }\n";
+    }
+    src << "}\n";
+
+    return src.str();
+}
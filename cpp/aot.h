@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// version of the interface of the compiled sheet
+const int AOT_VERSION = 1;
+
+// Value of a cell exchanged with the sheet compiled ahead of time
+// (see Tokenizer::generate_source()). tag is the type of Token, aux is
+// the error code of the error or the index of the cell the string comes
+// from (the strings are never copied), num is the number.
+struct AotValue {
+    int tag;
+    int aux;
+    double num;
+};
+
+// Hash of the expressions of the table (with their positions) and of its
+// size, the compiled sheet is kept in the cache under it
+class FormulaHash {
+    uint64_t m_hash;
+
+    void add(const void *data, const size_t size);
+
+public:
+    FormulaHash(const short rows, const short cols);
+
+    // adds the expression of the cell with the given index
+    void add(const int idx, const string &text);
+
+    // hash as hexadecimal string
+    string to_string() const;
+};
+
+// Shared library of the compiled sheet loaded into the process
+class AotLibrary {
+    typedef void (*eval_t)(AotValue *cells);
+    typedef const int* (*inputs_t)(int *count);
+
+    void *m_handle;
+    eval_t m_eval;
+    inputs_t m_inputs;
+
+public:
+    AotLibrary() : m_handle(nullptr), m_eval(nullptr), m_inputs(nullptr) { }
+    ~AotLibrary();
+
+    AotLibrary(const AotLibrary&) = delete;
+    AotLibrary& operator=(const AotLibrary&) = delete;
+
+    // loads the library, returns false if there is no usable one
+    bool load(const string &path);
+
+    // cells which are not expressions read by the expressions
+    vector<int> get_inputs() const;
+
+    // evaluates all the expressions, the input cells are already set
+    void eval(AotValue *cells) const {
+        m_eval(cells);
+    }
+};
+
+// path of the compiled sheet with the given hash in the cache directory
+// (ELTAB_CACHE or the cache directory of the user), empty if there is
+// no such directory
+string get_cache_path(const string &hash);
+
+// compiles the source into the shared library at the path by the system
+// compiler (CXX or c++, cl on Windows), returns false on failure
+bool build_library(const string &source, const string &path);
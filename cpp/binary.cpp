@@ -0,0 +1,304 @@
+#include <cstring>
+#include <fstream>
+
+#include "binary.h"
+
+static const char ELTB_MAGIC[4] = { 'E', 'L', 'T', 'B' };
+
+// offset rounded up to the alignment of the sections
+static size_t align(const size_t offset) {
+    return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+// FNV-1a hash of the bytes
+static uint64_t get_checksum(const char *data, const size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) *
+            1099511628211ull;
+    }
+    return hash;
+}
+
+// checks that the program runs on the stack of the machine the way the
+// compiled ones do (see Compiler::compile()) with the known operators
+// and errors, so it can be optimized and evaluated: the operator follows
+// its second operand, the references beyond the full stack are only
+// touched, the error and the result of the last reference end the program
+static bool is_valid_program(const Program &prog) {
+    const vector<Instr> &code = prog.m_code;
+    int depth = 0;
+    bool has_ref = false;
+    int last_ref = 0;
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        const Instr &in = code[pc];
+        const bool last = pc + 1 == code.size();
+        switch (in.code) {
+        case Instr::I_NUM:
+        case Instr::I_REF:
+            if (++depth > Program::MAX_STACK) {
+                return false;
+            }
+            if (in.code == Instr::I_REF) {
+                has_ref = true;
+                last_ref = in.arg;
+            }
+            break;
+        case Instr::I_OPER:
+            if (depth != 2 ||
+                (code[pc - 1].code != Instr::I_NUM &&
+                code[pc - 1].code != Instr::I_REF) ||
+                in.arg < OP_ADD || in.arg > OP_DIV) {
+                return false;
+            }
+            depth = 1;
+            break;
+        case Instr::I_TOUCH:
+            if (depth != Program::MAX_STACK) {
+                return false;
+            }
+            has_ref = true;
+            last_ref = in.arg;
+            break;
+        case Instr::I_ERROR:
+            if (!last || in.arg <= E_NONE || in.arg > E_TIMEOUT) {
+                return false;
+            }
+            break;
+        case Instr::I_RESULT:
+            if (!last || depth != Program::MAX_STACK || !has_ref ||
+                in.arg != last_ref) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+// checks that the program of the cell references the cells of the table
+// only
+static bool is_in_table(const Program &prog, const int idx,
+    const int n_cells) {
+    for (const Instr &in : prog.m_code) {
+        if ((in.code == Instr::I_REF || in.code == Instr::I_TOUCH ||
+            in.code == Instr::I_RESULT) &&
+            (in.arg < -idx || in.arg >= n_cells - idx)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BinaryTable::Layout::Layout(const Header &header) {
+    size_t n_cells = static_cast<size_t>(header.rows) * header.cols;
+    kinds = sizeof(Header);
+    values = align(kinds + n_cells);
+    offsets = values + n_cells * sizeof(uint64_t);
+    code = align(offsets + (header.shapes + size_t(1)) * sizeof(uint32_t));
+    strings = code + header.code_size * sizeof(Code);
+    end = strings + header.strings_size;
+}
+
+// ctor, the header is read in place
+BinaryTable::BinaryTable(const InputText &input) : m_input(input),
+    m_header(nullptr) {
+    if (input.size() >= sizeof(Header) &&
+        memcmp(input.data(), ELTB_MAGIC, sizeof(ELTB_MAGIC)) == 0) {
+        m_header = reinterpret_cast<const Header*>(input.data());
+    }
+}
+
+// the sizes are checked before the layout is worked out from them, so
+// it never overflows
+bool BinaryTable::validate(string &error) const {
+    const Header &header = *m_header;
+    if (header.version != ELTB_VERSION) {
+        error = "unsupported version " + to_string(header.version);
+        return false;
+    }
+    if (header.rows <= 0 || header.rows > numeric_limits<short>::max() ||
+        header.cols <= 0 || header.cols > 52 ||
+        header.strings_size > m_input.size() ||
+        header.code_size > m_input.size() / sizeof(Code)) {
+        error = "malformed header";
+        return false;
+    }
+    Layout layout(header);
+    if (layout.end != m_input.size()) {
+        error = "wrong size";
+        return false;
+    }
+    if (get_checksum(m_input.data() + sizeof(Header),
+        m_input.size() - sizeof(Header)) != header.checksum) {
+        error = "wrong checksum";
+        return false;
+    }
+    return true;
+}
+
+// the shapes are built first, the cells then refer to them
+bool BinaryTable::load(string **cells, vector<Expr> &expressions,
+    ShapeTable &shapes, Optimizer &optimizer, const bool optimize,
+    string &error) const {
+    const Header &header = *m_header;
+    const Layout layout(header);
+    const char *data = m_input.data();
+    const uint8_t *kinds =
+        reinterpret_cast<const uint8_t*>(data + layout.kinds);
+    const uint64_t *values =
+        reinterpret_cast<const uint64_t*>(data + layout.values);
+    const uint32_t *offsets =
+        reinterpret_cast<const uint32_t*>(data + layout.offsets);
+    const Code *code = reinterpret_cast<const Code*>(data + layout.code);
+    const char *strings = data + layout.strings;
+    error = "malformed contents";
+
+    vector<int> ids(header.shapes);
+    Program prog;
+    for (uint32_t s = 0; s < header.shapes; s++) {
+        if (offsets[s] > offsets[s + 1] || offsets[s + 1] > header.code_size) {
+            return false;
+        }
+        prog.m_code.clear();
+        for (uint32_t pc = offsets[s]; pc < offsets[s + 1]; pc++) {
+            prog.m_code.push_back(Instr(
+                static_cast<Instr::opcode>(code[pc].code), code[pc].arg));
+        }
+        if (!is_valid_program(prog)) {
+            return false;
+        }
+        if (optimize) {
+            optimizer.optimize(prog);
+        }
+        ids[s] = shapes.intern(prog);
+    }
+
+    const int n_cells = header.rows * header.cols;
+    for (int idx = 0; idx < n_cells; idx++) {
+        string &cell = cells[idx / header.cols][idx % header.cols];
+        uint64_t value = values[idx];
+        switch (kinds[idx]) {
+        case K_EMPTY:
+            break;
+        case K_NUMBER:
+            cell = to_string(value);
+            break;
+        case K_TEXT: {
+            uint32_t size;
+            if (header.strings_size < sizeof(size) ||
+                value > header.strings_size - sizeof(size)) {
+                return false;
+            }
+            memcpy(&size, strings + value, sizeof(size));
+            if (size > header.strings_size - sizeof(size) - value) {
+                return false;
+            }
+            cell.assign(strings + value + sizeof(size), size);
+            break;
+        }
+        case K_EXPRESSION:
+            if (value >= header.shapes ||
+                !is_in_table(shapes.get(ids[value]), idx, n_cells)) {
+                return false;
+            }
+            cell = "=";
+            expressions.push_back(Expr(make_pair(
+                static_cast<short>(idx / header.cols),
+                static_cast<short>(idx % header.cols)), ids[value]));
+            break;
+        case K_UNKNOWN:
+            cell = "#E_UNKNOWN";
+            break;
+        default:
+            return false;
+        }
+    }
+    error.clear();
+    return true;
+}
+
+// the strings are pooled, so each distinct text is stored once
+bool BinaryTable::write(const string &path, const short rows,
+    const short cols, string **cells, const vector<Expr> &expressions,
+    const ShapeTable &shapes) {
+    const size_t n_cells = static_cast<size_t>(rows) * cols;
+    vector<uint8_t> kinds(n_cells, K_EMPTY);
+    vector<uint64_t> values(n_cells, 0);
+    string strings;
+    unordered_map<string, uint64_t> pool;
+
+    for (size_t idx = 0; idx < n_cells; idx++) {
+        const string &s = cells[idx / cols][idx % cols];
+        long long num;
+        if (s.empty() || is_expression(s)) {
+            continue; // the expressions are taken from the list
+        }
+        else if (s == "#E_UNKNOWN") {
+            kinds[idx] = K_UNKNOWN;
+        }
+        else if (is_number(s) && (s.size() == 1 || s[0] != '0') &&
+            get_int64_by_str(s, num)) {
+            kinds[idx] = K_NUMBER;
+            values[idx] = static_cast<uint64_t>(num);
+        }
+        else {
+            auto it = pool.find(s);
+            if (it == pool.end()) {
+                it = pool.emplace(s, strings.size()).first;
+                uint32_t size = static_cast<uint32_t>(s.size());
+                strings.append(reinterpret_cast<const char*>(&size),
+                    sizeof(size));
+                strings.append(s);
+            }
+            kinds[idx] = K_TEXT;
+            values[idx] = it->second;
+        }
+    }
+    for (auto &ex : expressions) {
+        size_t idx = static_cast<size_t>(ex.m_coords.first) * cols +
+            ex.m_coords.second;
+        kinds[idx] = K_EXPRESSION;
+        values[idx] = static_cast<uint64_t>(ex.m_shape);
+    }
+
+    vector<uint32_t> offsets(1, 0);
+    vector<Code> code;
+    for (size_t s = 0; s < shapes.size(); s++) {
+        for (const Instr &in : shapes.get(static_cast<int>(s)).m_code) {
+            code.push_back(Code{ in.code, in.arg });
+        }
+        offsets.push_back(static_cast<uint32_t>(code.size()));
+    }
+
+    Header header;
+    memcpy(header.magic, ELTB_MAGIC, sizeof(ELTB_MAGIC));
+    header.version = ELTB_VERSION;
+    header.checksum = 0;
+    header.rows = rows;
+    header.cols = cols;
+    header.shapes = static_cast<uint32_t>(shapes.size());
+    header.code_size = static_cast<uint32_t>(code.size());
+    header.strings_size = strings.size();
+
+    Layout layout(header);
+    vector<char> file(layout.end, 0);
+    memcpy(file.data() + layout.kinds, kinds.data(), kinds.size());
+    memcpy(file.data() + layout.values, values.data(),
+        values.size() * sizeof(uint64_t));
+    memcpy(file.data() + layout.offsets, offsets.data(),
+        offsets.size() * sizeof(uint32_t));
+    memcpy(file.data() + layout.code, code.data(),
+        code.size() * sizeof(Code));
+    memcpy(file.data() + layout.strings, strings.data(), strings.size());
+    header.checksum = get_checksum(file.data() + sizeof(Header),
+        file.size() - sizeof(Header));
+    memcpy(file.data(), &header, sizeof(Header));
+
+    ofstream out(path, ios::binary);
+    out.write(file.data(), file.size());
+    out.close(); // the data left in the buffer is written out here
+    return !out.fail();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "eltab.h"
+#include "input.h"
+
+// version of the binary table format
+const uint32_t ELTB_VERSION = 1;
+
+// Table in the binary format (.eltb, see --convert) which is loaded
+// without scanning the text and compiling the expressions: the cells are
+// kept as typed columns, the expressions as their compiled programs.
+// The table of main() keeps the text of the cells for printing them
+// out, so the numbers are written out as text again on load. The file
+// is
+//     header      magic "ELTB", version, checksum of the rest, sizes
+//     kinds       one byte of the kind (cell_kind) per cell
+//     values      eight bytes per cell: the number, the offset of the
+//                 text in the strings or the shape of the expression
+//     offsets     start of the code of each shape and its end
+//     code        instructions of the shapes (see Program)
+//     strings     distinct texts of the cells, each after its length
+// in the byte order of the machine, each section aligned to eight
+// bytes. The programs are stored as compiled, so --no-optimize works
+// with them, and the references are relative to the cells, so each
+// shape is stored once. The order of evaluation depends on the printed
+// columns and on --int64 and is worked out on load in one pass as it
+// is for the text table.
+class BinaryTable {
+public:
+    enum cell_kind : uint8_t {
+        K_EMPTY,
+        K_NUMBER,       // digits without leading zeros fitting 64 bits
+        K_TEXT,         // string literal or other number (e.g. 007)
+        K_EXPRESSION,
+        K_UNKNOWN       // unsupported cell (#E_UNKNOWN)
+    };
+
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t checksum;      // FNV-1a of everything after the header
+        int32_t rows;
+        int32_t cols;
+        uint32_t shapes;        // number of the shapes
+        uint32_t code_size;     // number of the instructions of them all
+        uint64_t strings_size;  // bytes of the strings
+    };
+
+    // instruction as it is stored
+    struct Code {
+        int32_t code;
+        int32_t arg;
+    };
+
+    // offsets of the sections
+    struct Layout {
+        size_t kinds;
+        size_t values;
+        size_t offsets;
+        size_t code;
+        size_t strings;
+        size_t end;
+
+        explicit Layout(const Header &header);
+    };
+
+    const InputText &m_input;
+    const Header *m_header;     // nullptr if the input is not binary
+
+public:
+    // ctor, the input is binary if it starts with the magic
+    explicit BinaryTable(const InputText &input);
+
+    // checks that the input is the binary table
+    bool is_binary() const {
+        return m_header != nullptr;
+    }
+
+    // checks the version, the sizes and the checksum, returns false
+    // with the reason if the table can't be loaded
+    bool validate(string &error) const;
+
+    short get_rows() const {
+        return static_cast<short>(m_header->rows);
+    }
+    short get_cols() const {
+        return static_cast<short>(m_header->cols);
+    }
+
+    // fills out the validated table as main() does from the text: the
+    // expressions get "=" and are added with their shapes, optimized if
+    // optimize is set; returns false with the reason if the contents
+    // are malformed (e.g. the reference out of the table)
+    bool load(string **cells, vector<Expr> &expressions, ShapeTable &shapes,
+        Optimizer &optimizer, const bool optimize, string &error) const;
+
+    // writes the table filled out by main() with the expressions compiled
+    // and not optimized into the file, returns false on failure
+    static bool write(const string &path, const short rows,
+        const short cols, string **cells, const vector<Expr> &expressions,
+        const ShapeTable &shapes);
+};
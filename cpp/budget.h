@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+// Token through which the evaluation is cancelled from another thread
+// (see Options::cancel)
+class CancelToken {
+    atomic<bool> m_cancelled;
+
+public:
+    CancelToken() : m_cancelled(false) { }
+
+    CancelToken(const CancelToken&) = delete;
+    CancelToken& operator=(const CancelToken&) = delete;
+
+    // asks the evaluation to stop
+    void cancel() {
+        m_cancelled.store(true, memory_order_relaxed);
+    }
+
+    bool is_cancelled() const {
+        return m_cancelled.load(memory_order_relaxed);
+    }
+};
+
+// Budget of one evaluation: the deadline, the number of operations (the
+// instructions of the evaluated expressions) and the cancellation token.
+// Each thread counts the operations of the cells it evaluates and
+// reports them each CHECK cells, then the budget is checked. They are
+// reported right away if together with the ones reported so far they
+// exceed the limit of the operations or if the evaluation is cancelled,
+// so only the deadline waits for the report. Once the budget is
+// exceeded, it stays so till the next evaluation starts.
+class Budget {
+    static const unsigned CHECK = 256;
+
+    // operations and cells counted by the thread and not reported yet
+    struct Meter {
+        const Budget *budget;   // budget of the counted cells
+        unsigned epoch;         // evaluation of the counted cells
+        size_t ops;
+        unsigned cells;
+    };
+    static Meter& get_meter() {
+        static thread_local Meter meter = { nullptr, 0, 0, 0 };
+        return meter;
+    }
+
+    bool m_active;                  // there is some limit
+    bool m_has_deadline;
+    chrono::steady_clock::time_point m_deadline;
+    size_t m_max_ops;               // 0 if there is no limit
+    const CancelToken *m_cancel;    // nullptr if there is none
+    unsigned m_epoch;               // number of the evaluations started
+    atomic<size_t> m_ops;           // operations reported so far
+    atomic<bool> m_exceeded;
+
+    // adds the operations reported by the thread and checks the limits
+    bool report(const size_t ops) {
+        size_t total = m_ops.fetch_add(ops, memory_order_relaxed) + ops;
+        if ((m_max_ops > 0 && total > m_max_ops) ||
+            (m_has_deadline && chrono::steady_clock::now() > m_deadline) ||
+            (m_cancel != nullptr && m_cancel->is_cancelled())) {
+            m_exceeded.store(true, memory_order_relaxed);
+        }
+        return !is_exceeded();
+    }
+
+public:
+    Budget() : m_active(false), m_has_deadline(false), m_max_ops(0),
+        m_cancel(nullptr), m_epoch(0), m_ops(0), m_exceeded(false) { }
+
+    // starts the evaluation with the given limits, the deadline is
+    // given in milliseconds from now (0 if there is none)
+    void start(const unsigned deadline_ms, const size_t max_ops,
+        const CancelToken *cancel) {
+        m_has_deadline = deadline_ms > 0;
+        m_deadline = chrono::steady_clock::now() +
+            chrono::milliseconds(deadline_ms);
+        m_max_ops = max_ops;
+        m_cancel = cancel;
+        m_active = m_has_deadline || m_max_ops > 0 || m_cancel != nullptr;
+        m_epoch++;
+        m_ops.store(0, memory_order_relaxed);
+        m_exceeded.store(false, memory_order_relaxed);
+    }
+
+    // checks that there is some limit
+    bool is_active() const {
+        return m_active;
+    }
+
+    bool is_exceeded() const {
+        return m_exceeded.load(memory_order_relaxed);
+    }
+
+    // counts the given number of cells with their operations evaluated
+    // by the calling thread, returns false if the budget is exceeded
+    bool charge(const size_t ops, const unsigned cells = 1) {
+        if (is_exceeded()) {
+            return false;
+        }
+        Meter &meter = get_meter();
+        if (meter.budget != this || meter.epoch != m_epoch) {
+            meter = Meter{ this, m_epoch, 0, 0 };
+        }
+        meter.ops += ops;
+        meter.cells += cells;
+        if (meter.cells < CHECK && (m_max_ops == 0 ||
+            m_ops.load(memory_order_relaxed) + meter.ops <= m_max_ops) &&
+            (m_cancel == nullptr || !m_cancel->is_cancelled())) {
+            return true;
+        }
+        size_t reported = meter.ops;
+        meter.ops = 0;
+        meter.cells = 0;
+        return report(reported);
+    }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <climits>
+
+#include "program.h"
+
+// Applies the operator to 64-bit integers, returns E_NONE with the
+// result in res, E_OVERFLOW if the result doesn't fit or E_INFINITE for
+// division by zero. The division truncates toward zero as the double
+// division truncated to int does.
+inline err_code apply_checked(const oper op, const long long a,
+    const long long b, long long &res) {
+    bool overflow = false;
+    switch (op) {
+#if defined(__GNUC__)
+    case OP_ADD: overflow = __builtin_add_overflow(a, b, &res);
+        break;
+    case OP_SUB: overflow = __builtin_sub_overflow(a, b, &res);
+        break;
+    case OP_MUL: overflow = __builtin_mul_overflow(a, b, &res);
+        break;
+#else
+    case OP_ADD:
+        overflow = (b > 0) ? a > LLONG_MAX - b : a < LLONG_MIN - b;
+        res = overflow ? 0 : a + b;
+        break;
+    case OP_SUB:
+        overflow = (b < 0) ? a > LLONG_MAX + b : a < LLONG_MIN + b;
+        res = overflow ? 0 : a - b;
+        break;
+    case OP_MUL:
+        if (a == 0 || b == 0) {
+            res = 0;
+            break;
+        }
+        if (a > 0) {
+            overflow = (b > 0) ? a > LLONG_MAX / b : b < LLONG_MIN / a;
+        }
+        else {
+            overflow = (b > 0) ? a < LLONG_MIN / b : b < LLONG_MAX / a;
+        }
+        res = overflow ? 0 : a * b;
+        break;
+#endif
+    case OP_DIV:
+        if (b == 0) {
+            return E_INFINITE;
+        }
+        overflow = a == LLONG_MIN && b == -1;
+        res = overflow ? 0 : a / b;
+        break;
+    default:
+        return E_UNKNOWN_OP;
+    }
+    return overflow ? E_OVERFLOW : E_NONE;
+}
@@ -0,0 +1,208 @@
+#include "eltab.h"
+#include "kernels.h"
+
+// checks that the program is of the form x0 op1 x1 op2 x2 ... where
+// operands are numbers or references, the only form the column kernel
+// evaluates
+static bool is_column_program(const Program &prog) {
+    const vector<Instr> &code = prog.m_code;
+    auto is_operand = [](const Instr &in) {
+        return in.code == Instr::I_NUM || in.code == Instr::I_REF;
+    };
+
+    if (code.size() < 3 || code.size() % 2 == 0 || !is_operand(code[0])) {
+        return false;
+    }
+    for (size_t pc = 1; pc < code.size(); pc += 2) {
+        if (!is_operand(code[pc]) || code[pc + 1].code != Instr::I_OPER ||
+            code[pc + 1].arg < OP_ADD || code[pc + 1].arg > OP_DIV) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Evaluates the expressions copied down the columns (e.g. =A1*B1,
+// =A2*B2, ...) by the column kernel (see eval_column()) instead of one
+// by one, and takes them out of the order of evaluation.
+// The expression is evaluated by the kernel if its program has the
+// suitable form, it has no stop, shares no prefix (see share_prefixes())
+// and it references only the cells which are not expressions or are
+// evaluated by the kernel themselves. Its level is one more than the highest level of such expressions it
+// references. The vertical runs of the cells of the same level with the
+// same shape are evaluated at once, level by level. The runs are cut at
+// each BLOCK rows and the runs of the same block are evaluated one after
+// another, so the rows they read stay in cache. The integer mode has its
+// own kernel (see eval_column_int()).
+void Tokenizer::run_columns() {
+    const int BLOCK = 256;
+
+    struct Run {
+        int first;  // index of the first cell
+        int count;  // number of the cells
+        int level;  // level of the cells
+    };
+
+    // 0 for the cells which are not evaluated by the kernel
+    vector<int> levels(m_cells.size(), 0);
+    for (int idx : m_order) {
+        if (!is_column_program(*m_programs[idx]) ||
+            m_stops[idx].first >= 0 ||
+            (!m_shared.empty() && m_shared[idx].first >= 0)) {
+            continue;
+        }
+        int level = 1;
+        for (const int *dep = m_graph.deps_begin(idx);
+            dep < m_graph.deps_end(idx) && level > 0; ++dep) {
+            if (m_programs[*dep] != nullptr) {
+                level = (levels[*dep] > 0) ?
+                    max(level, levels[*dep] + 1) : 0;
+            }
+        }
+        levels[idx] = level;
+    }
+
+    // the runs are found in the order of the table, the last run of
+    // each column is continued by the cell below it
+    vector<Run> runs;
+    vector<int> open(m_cols, -1);
+    for (int idx = 0; idx < static_cast<int>(m_cells.size()); idx++) {
+        int &last = open[idx % m_cols];
+        if (levels[idx] == 0) {
+            last = -1;
+            continue;
+        }
+        if (last >= 0) {
+            Run &run = runs[last];
+            if (run.level == levels[idx] &&
+                m_programs[run.first] == m_programs[idx] &&
+                (idx / m_cols) % BLOCK != 0) {
+                run.count++;
+                continue;
+            }
+        }
+        last = static_cast<int>(runs.size());
+        runs.push_back(Run{ idx, 1, levels[idx] });
+    }
+    // the runs within the same BLOCK of rows are evaluated together
+    stable_sort(runs.begin(), runs.end(), [&](const Run &a, const Run &b) {
+        return a.level < b.level || (a.level == b.level &&
+            a.first / m_cols / BLOCK < b.first / m_cols / BLOCK);
+    });
+
+    vector<oper> ops;
+    vector<KernelOperand> operands;
+    vector<vector<double>> columns;
+    vector<double> out;
+    vector<unsigned char> errors;
+
+    // the run of the integer mode, the operands are gathered into the
+    // columns of integers with the flags of the numbers
+    vector<IntKernelOperand> int_operands;
+    vector<vector<long long>> int_columns;
+    vector<vector<unsigned char>> valid;
+    vector<long long> int_out;
+    auto eval_int_run = [&](const Run &run, const vector<Instr> &code) {
+        int_operands.clear();
+        int_columns.assign(code.size(), vector<long long>());
+        valid.assign(code.size(), vector<unsigned char>());
+        for (size_t pc = 0; pc < code.size(); pc++) {
+            const Instr &in = code[pc];
+            if (in.code == Instr::I_NUM) {
+                int_operands.push_back(IntKernelOperand(
+                    static_cast<long long>(in.arg)));
+            }
+            if (in.code != Instr::I_REF) {
+                continue;
+            }
+            int_columns[pc].resize(run.count);
+            valid[pc].resize(run.count);
+            for (int j = 0; j < run.count; j++) {
+                const Token &tok =
+                    m_cells[run.first + j * m_cols + in.arg].value;
+                valid[pc][j] = tok.type == Token::T_INTEGER;
+                int_columns[pc][j] = valid[pc][j] ? tok.i_value : 0;
+            }
+            int_operands.push_back(IntKernelOperand(int_columns[pc].data(),
+                valid[pc].data()));
+        }
+
+        int_out.resize(run.count);
+        errors.resize(run.count);
+        eval_column_int(ops, int_operands, run.count, int_out.data(),
+            errors.data());
+        for (int j = 0; j < run.count; j++) {
+            m_cells[run.first + j * m_cols].value = (errors[j] != E_NONE) ?
+                Token(static_cast<err_code>(errors[j])) : Token(int_out[j]);
+        }
+    };
+
+    for (Run run : runs) {
+        const vector<Instr> &code = m_programs[run.first]->m_code;
+        ops.clear();
+        operands.clear();
+        for (const Instr &in : code) {
+            if (in.code == Instr::I_OPER) {
+                ops.push_back(static_cast<oper>(in.arg));
+            }
+        }
+        m_column_cells += run.count;
+        // the cells are charged one by one as eval_cell() does, the ones
+        // within the budget are evaluated and the rest get #E_TIMEOUT
+        if (m_budget.is_active()) {
+            int count = 0;
+            while (count < run.count && m_budget.charge(code.size())) {
+                count++;
+            }
+            for (int j = count; j < run.count; j++) {
+                m_cells[run.first + j * m_cols].value = Token(E_TIMEOUT);
+            }
+            run.count = count;
+            if (count == 0) {
+                continue;
+            }
+        }
+        if (m_int64) {
+            eval_int_run(run, code);
+            continue;
+        }
+        columns.assign(code.size(), vector<double>());
+
+        // the operands are gathered into the columns of numbers,
+        // NaN where the referenced cell is not a number
+        for (size_t pc = 0; pc < code.size(); pc++) {
+            const Instr &in = code[pc];
+            if (in.code == Instr::I_OPER) {
+                continue;
+            }
+            if (in.code == Instr::I_NUM) {
+                operands.push_back(KernelOperand(
+                    static_cast<double>(in.arg)));
+                continue;
+            }
+            vector<double> &column = columns[pc];
+            column.resize(run.count);
+            for (int j = 0; j < run.count; j++) {
+                const Token &tok =
+                    m_cells[run.first + j * m_cols + in.arg].value;
+                column[j] = (tok.type == Token::T_NUMBER) ? tok.n_value :
+                    numeric_limits<double>::quiet_NaN();
+            }
+            operands.push_back(KernelOperand(column.data()));
+        }
+
+        out.resize(run.count);
+        errors.resize(run.count);
+        eval_column(ops, operands, run.count, out.data(), errors.data());
+
+        for (int j = 0; j < run.count; j++) {
+            m_cells[run.first + j * m_cols].value = (errors[j] != E_NONE) ?
+                Token(static_cast<err_code>(errors[j])) :
+                Token(static_cast<int>(out[j]));
+        }
+    }
+    m_column_runs += runs.size();
+
+    m_order.erase(remove_if(m_order.begin(), m_order.end(),
+        [&](const int idx) { return levels[idx] > 0; }), m_order.end());
+}
@@ -0,0 +1,209 @@
+#include <cstdint>
+
+#include "eltab.h"
+
+// Prefixes of the expressions kept as a trie: the prefix is its first
+// operand followed by the steps (operator with its right operand), each
+// node is the prefix of its parent extended by one step. The references
+// are the absolute cells, so the same node is the same computation
+// whatever expression it's found in. The nodes are kept in the table
+// with open addressing; the slot keeps the upper half of the hash of its
+// node, so the nodes are read only when the hashes are equal.
+class PrefixTrie {
+public:
+    struct Node {
+        int parent;     // parent node, -1 for the first operand
+        int operand;    // instruction code of the operand
+        int arg;        // number or absolute index of the referenced cell
+        int op;         // operator, OP_NONE for the first operand
+        int depth;      // number of the steps
+        int count;      // expressions starting with the prefix
+        int cell;       // the first expression which got here
+        int pc;         // position of its next step
+    };
+
+private:
+    vector<Node> m_nodes;
+    // upper half of the hash and node id + 1 (0 for empty slots)
+    vector<uint64_t> m_slots;
+
+    static uint64_t hash(const int parent, const int operand, const int arg,
+        const int op) {
+        uint64_t h = static_cast<uint32_t>(parent);
+        h = h * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(arg);
+        h = h * 0x9E3779B97F4A7C15ull + (operand << 8 | op);
+        h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDull; // mixing all the bits
+        return h ^ (h >> 33);
+    }
+
+    // puts the node with the given hash into the free slot
+    void place(const uint64_t h, const int id) {
+        size_t mask = m_slots.size() - 1;
+        size_t s = static_cast<size_t>(h) & mask;
+        while (m_slots[s] != 0) { s = (s + 1) & mask; }
+        m_slots[s] = (h & 0xFFFFFFFF00000000ull) | (id + 1);
+    }
+
+public:
+    // ctor, the table is made for the given number of nodes and grows
+    PrefixTrie(const size_t nodes) {
+        size_t size = 16;
+        while (size < nodes * 2) { size *= 2; }
+        m_slots.assign(size, 0);
+        m_nodes.reserve(nodes);
+    }
+
+    // returns id of the node, -1 if there is none and add is false
+    int get(const int parent, const int operand, const int arg,
+        const int op, const bool add) {
+        uint64_t h = hash(parent, operand, arg, op);
+        uint64_t tag = h & 0xFFFFFFFF00000000ull;
+        size_t mask = m_slots.size() - 1;
+        for (size_t s = static_cast<size_t>(h) & mask; m_slots[s] != 0;
+            s = (s + 1) & mask) {
+            if ((m_slots[s] & 0xFFFFFFFF00000000ull) != tag) {
+                continue;
+            }
+            int id = static_cast<int>(m_slots[s] & 0xFFFFFFFF) - 1;
+            const Node &n = m_nodes[id];
+            if (n.parent == parent && n.operand == operand &&
+                n.arg == arg && n.op == op) {
+                return id;
+            }
+        }
+        if (!add) {
+            return -1;
+        }
+
+        if (m_nodes.size() * 2 >= m_slots.size()) {
+            m_slots.assign(m_slots.size() * 2, 0);
+            for (size_t id = 0; id < m_nodes.size(); id++) {
+                const Node &n = m_nodes[id];
+                place(hash(n.parent, n.operand, n.arg, n.op),
+                    static_cast<int>(id));
+            }
+        }
+        int depth = (parent < 0) ? 0 : m_nodes[parent].depth + 1;
+        Node node = { parent, operand, arg, op, depth, 0, -1, -1 };
+        m_nodes.push_back(node);
+        place(h, static_cast<int>(m_nodes.size() - 1));
+        return static_cast<int>(m_nodes.size() - 1);
+    }
+
+    Node& operator[](const int id) {
+        return m_nodes[id];
+    }
+};
+
+// Finds the prefixes which several expressions start with (e.g. =A1+B1*C1
+// of =A1+B1*C1/5 and =A1+B1*C1-7), so each is evaluated once. As the
+// evaluation goes strictly left to right, the value of the expression up
+// to any of its operators depends only on the instructions before it.
+// The prefixes made of numbers, references and operators and ending with
+// the operator are compared with the references taken as the absolute
+// cells (see PrefixTrie). Most of the prefixes are not shared, so the
+// expression is followed down the trie only to the first node no other
+// expression got to; the first expression there is followed one step
+// further when another one gets there.
+// Each expression starts with the longest of its prefixes found in
+// another expression too. The prefix is evaluated by the first expression
+// in order which starts with it (its owner), the others continue from
+// its value after the owner is evaluated. The expressions which stop at
+// load time (see m_stops) are left as they are.
+void Tokenizer::share_prefixes() {
+    m_prefixes.clear();
+    m_shared.clear();
+    m_shared_ops = 0;
+
+    PrefixTrie trie(m_order.size() * 2);
+    // the deepest node each expression got to
+    vector<int> last(m_cells.size(), -1);
+
+    // gets the node of the step of the expression at the position,
+    // -1 if the expression has no such step
+    auto get_step = [&](const int idx, const int parent, const size_t pc,
+        const bool add) {
+        const vector<Instr> &code = m_programs[idx]->m_code;
+        if (pc >= code.size() || (code[pc].code != Instr::I_NUM &&
+            code[pc].code != Instr::I_REF)) {
+            return -1;
+        }
+        int op = OP_NONE;
+        if (pc > 0) {
+            if (pc + 1 >= code.size() || code[pc + 1].code != Instr::I_OPER) {
+                return -1;
+            }
+            op = code[pc + 1].arg;
+        }
+        int arg = (code[pc].code == Instr::I_REF) ? idx + code[pc].arg :
+            code[pc].arg;
+        return trie.get(parent, code[pc].code, arg, op, add);
+    };
+    auto next_pc = [](const size_t pc) {
+        return (pc == 0) ? 1 : pc + 2;
+    };
+
+    for (int idx : m_order) {
+        if (m_stops[idx].first >= 0) {
+            continue;
+        }
+        int node = -1;
+        for (size_t pc = 0; ; pc = next_pc(pc)) {
+            node = get_step(idx, node, pc, true);
+            if (node < 0) {
+                break;
+            }
+            last[idx] = node;
+            PrefixTrie::Node &n = trie[node];
+            if (++n.count == 1) { // the first expression stops here
+                n.cell = idx;
+                n.pc = static_cast<int>(next_pc(pc));
+                break;
+            }
+            if (n.count == 2) { // the first expression goes one step on
+                int cell = n.cell;
+                int first_pc = n.pc;
+                int child = get_step(cell, node, first_pc, true);
+                if (child >= 0) {
+                    PrefixTrie::Node &c = trie[child];
+                    c.count++;
+                    c.cell = cell;
+                    c.pc = static_cast<int>(next_pc(first_pc));
+                    last[cell] = child;
+                }
+            }
+        }
+    }
+
+    unordered_map<int, int> ids;    // shared prefixes by their nodes
+    m_shared.assign(m_cells.size(), make_pair(-1, 0));
+    for (int idx : m_order) {
+        if (m_stops[idx].first >= 0) {
+            continue;
+        }
+        // the prefix is shared if its node is, so are its parents
+        int shared = last[idx];
+        while (shared >= 0 && trie[shared].count < 2) {
+            shared = trie[shared].parent;
+        }
+        if (shared < 0 || trie[shared].depth == 0) {
+            continue;
+        }
+        size_t ops = trie[shared].depth;
+        size_t length = 2 * ops + 1;
+
+        auto id = ids.find(shared);
+        if (id == ids.end()) {
+            id = ids.emplace(shared, static_cast<int>(m_prefixes.size())).first;
+            const vector<Instr> &code = m_programs[idx]->m_code;
+            m_prefixes.push_back(SharedPrefix());
+            SharedPrefix &prefix = m_prefixes.back();
+            prefix.prefix.m_code.assign(code.begin(), code.begin() + length);
+            prefix.owner = idx;
+        }
+        else {
+            m_shared_ops += ops;
+        }
+        m_shared[idx] = make_pair(id->second, static_cast<int>(length));
+    }
+}
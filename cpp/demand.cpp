@@ -0,0 +1,207 @@
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include "eltab.h"
+
+// Evaluates the expressions on demand without working out the order
+// first: each worker takes the next of the given cells and follows its
+// references depth first the way sort() does, the component is evaluated
+// as soon as it is complete. The cell is claimed by the worker with the
+// compare-and-swap of its state, which is 0 for unvisited cell, the
+// worker + 1 while the worker has it in progress, DONE when the cell has
+// its value and MALFORMED for malformed cell which is not an expression.
+// The worker getting to the cell in progress by another one waits for it.
+// The workers may wait for each other in a circle only if their cells
+// are in a cycle of references, e.g. A1 is in progress by one of them
+// which gets to B1 while the other one with B1 gets to A1. The waiting
+// worker follows the cells the others wait for and if it gets back to
+// itself and is the highest of the workers of the circle, it releases
+// all its cells which are not done and starts over when the cell it
+// waited for is done: the cycle is left to the other worker and found by
+// it alone. The cells in cycles and depending on them get #E_CROSS_REF
+// the same as with sort(), so the results are the same as of serial
+// evaluation.
+void Tokenizer::run_demand(const unsigned threads, const vector<int> &roots) {
+    const unsigned n_workers = max(threads, 1u);
+    const int DONE = -1;
+    const int MALFORMED = -2;
+
+    struct Frame {
+        int cell;       // expression cell being traversed
+        const int *dep; // next reference to follow
+    };
+
+    unique_ptr<atomic<int>[]> claims(new atomic<int>[m_cells.size()]);
+    for (size_t c = 0; c < m_cells.size(); c++) {
+        claims[c].store((m_cells[c].state == CellValue::S_DONE) ? DONE : 0,
+            memory_order_relaxed);
+    }
+    // the cell each worker waits for, -1 if it doesn't wait
+    unique_ptr<atomic<int>[]> waiting(new atomic<int>[n_workers]);
+    for (unsigned w = 0; w < n_workers; w++) {
+        waiting[w].store(-1, memory_order_relaxed);
+    }
+    atomic<size_t> next_root(0);
+    m_worker_stats.assign(n_workers, WorkerStats());
+
+    auto worker = [&](const unsigned self) {
+        const int me = static_cast<int>(self) + 1;
+        WorkerStats &stats = m_worker_stats[self];
+        vector<Frame> stack;
+        vector<int> component;  // cells of the components not complete yet
+        int visited = 0;
+
+        auto enter = [&](const int cell) {
+            m_cells[cell].state = CellValue::S_IN_PROGRESS;
+            m_visit[cell] = m_low[cell] = visited++;
+            component.push_back(cell);
+            stack.push_back(Frame{ cell, m_graph.deps_begin(cell) });
+        };
+
+        // the component of the cell is complete, the cells it references
+        // are done or in the component
+        auto complete = [&](const int cell) {
+            auto first = find(component.begin(), component.end(), cell);
+            bool cycle = component.end() - first > 1;
+            for (auto it = first; it != component.end() && !cycle; ++it) {
+                for (const int *dep = m_graph.deps_begin(*it);
+                    dep < m_graph.deps_end(*it) && !cycle; ++dep) {
+                    if (claims[*dep].load(memory_order_relaxed) ==
+                        MALFORMED) {
+                        break; // the rest is never read
+                    }
+                    cycle = *dep == *it || is_cross_ref(*dep);
+                }
+            }
+            for (auto it = first; it != component.end(); ++it) {
+                if (cycle) {
+                    m_cells[*it].value = Token(E_CROSS_REF);
+                }
+                else {
+                    eval_cell(*it);
+                    stats.executed++;
+                }
+                m_cells[*it].state = CellValue::S_DONE;
+                claims[*it].store(DONE, memory_order_release);
+            }
+            component.erase(first, component.end());
+        };
+
+        // waits while the cell is in progress by another worker, returns
+        // false if this worker is to break the circle of waiting workers
+        auto wait_for = [&](const int cell) {
+            waiting[self].store(cell, memory_order_seq_cst);
+            stats.waits++;
+            bool wait = true;
+            int owner;
+            while ((owner = claims[cell].load(memory_order_acquire)) > 0 &&
+                owner != me) {
+                int top = me;
+                for (unsigned step = 0; step < n_workers; step++) {
+                    top = max(top, owner);
+                    int c = waiting[owner - 1].load(memory_order_acquire);
+                    owner = (c < 0) ? 0 : claims[c].load(memory_order_acquire);
+                    if (owner <= 0 || owner == me) {
+                        break;
+                    }
+                }
+                if (owner == me && top == me) {
+                    wait = false;
+                    break;
+                }
+                this_thread::yield();
+            }
+            waiting[self].store(-1, memory_order_release);
+            return wait;
+        };
+
+        // releases the cells in progress, their values are never set
+        auto back_off = [&]() {
+            for (int cell : component) {
+                m_stops[cell] = make_pair(-1, E_NONE);
+                m_cells[cell].state = CellValue::S_UNVISITED;
+                claims[cell].store(0, memory_order_release);
+            }
+            component.clear();
+            stack.clear();
+            stats.backoffs++;
+        };
+
+        // evaluates the root and the cells it references, returns false
+        // if the worker backed off and has to start over
+        auto resolve = [&](const int root) {
+            int expected = 0;
+            if (!claims[root].compare_exchange_strong(expected, me,
+                memory_order_acq_rel)) {
+                return true; // done or in progress by another worker
+            }
+            enter(root);
+            while (!stack.empty()) {
+                Frame &f = stack.back();
+
+                if (f.dep == m_graph.deps_end(f.cell)) {
+                    int cell = f.cell;
+                    stack.pop_back();
+                    if (!stack.empty()) {
+                        int &low = m_low[stack.back().cell];
+                        low = min(low, m_low[cell]);
+                    }
+                    if (m_low[cell] == m_visit[cell]) {
+                        complete(cell);
+                    }
+                    continue;
+                }
+
+                int dep = *f.dep++;
+                int state = claims[dep].load(memory_order_acquire);
+                if (state == 0) {
+                    if (!claims[dep].compare_exchange_strong(state, me,
+                        memory_order_acq_rel)) {
+                        f.dep--; // claimed by another worker, once again
+                        continue;
+                    }
+                    if (m_programs[dep] != nullptr) {
+                        enter(dep); // invalidates f
+                        continue;
+                    }
+                    state = parse_reference(dep) ? DONE : MALFORMED;
+                    claims[dep].store(state, memory_order_release);
+                }
+
+                if (state == me) {
+                    m_low[f.cell] = min(m_low[f.cell], m_visit[dep]);
+                }
+                else if (state == MALFORMED) {
+                    size_t k = f.dep - m_graph.deps_begin(f.cell) - 1;
+                    m_stops[f.cell] = make_pair(
+                        m_programs[f.cell]->get_ref_pc(k), E_WRONG_REF);
+                    f.dep = m_graph.deps_end(f.cell);
+                }
+                else if (state != DONE) {
+                    if (!wait_for(dep)) {
+                        back_off();
+                        wait_for(dep); // nothing is held, no circle
+                        return false;
+                    }
+                    f.dep--; // done or released, once again
+                }
+            }
+            return true;
+        };
+
+        for (size_t r = next_root.fetch_add(1); r < roots.size();
+            r = next_root.fetch_add(1)) {
+            if (m_programs[roots[r]] != nullptr) {
+                while (!resolve(roots[r])) { }
+            }
+        }
+    };
+
+    vector<thread> helpers;
+    for (unsigned w = 1; w < n_workers; w++) {
+        helpers.push_back(thread(worker, w));
+    }
+    worker(0);
+    for (auto &t : helpers) { t.join(); }
+}
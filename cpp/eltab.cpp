@@ -1,212 +1,284 @@
+#include <thread>
+#include <memory>
+
 #include "eltab.h"
+#include "aot.h"
+#include "loader.h"
+#include "stream.h"
+#include "binary.h"
+
+/* 1. gets the input: the file given by the path (mapped into memory) or
+      standard input, the table in the text or in the binary format
+   2. fills out the table (cells) with raw values, compiling expressions
+      (the binary table keeps them compiled)
+   3. orders expressions after the cells they reference and runs
+      evaluation process (calculating expressions and resolving
+      references)
+   4. prints out the results
 
-// starts the process of the parsing/evaluation of expressions
-// examines domain_error exceptions to get error code for
-// malformed cells or cross-references
-void Tokenizer::run() {
-    for (auto &ex : m_expressions) {
-        string scell = get_cell_by_coords(ex->m_coords);
+   Executable with args example: eltab.exe < $(TargetDir)\test.elt
+   or eltab.exe $(TargetDir)\test.elt
+   Options:
+     -j, --threads N   evaluate on N threads (0 - one per core)
+     --engine E        serial, levels, steal, demand or frames
+     --no-columns      evaluate copied down expressions one by one
+     --backend B       interp or jit (native code)
+     --compile         evaluate by the sheet compiled ahead of time
+     --no-optimize     evaluate the expressions as they are written
+     --cols LIST       print out only the given columns (e.g. A,C)
+     --cse             evaluate the prefixes shared by expressions once
+     --int64           evaluate in 64-bit integers with overflow checks
+     --deadline-ms N   stop evaluating after N milliseconds
+     --max-ops N       stop evaluating after N operations
+     --stream K|auto   evaluate row by row keeping K rows before it
+     --convert FILE    write the table in the binary format
+     --stats           print out evaluation statistics
+   Example of the contents of the test.elt (cells are tab-delimited):
 
-        if (map_ref_cells.find(scell) != map_ref_cells.end()) {
-            continue;
-        }
+3	4
+12 =C2	3	'Sample
+=A1+B1*C1/5 =A2*B1 =B3-C3	'Spread
+'Test	=4-3	5	'Sheet
 
-        map_ref_cells.emplace(make_pair(scell, Token()));
-        Token tok;
-        try
-        {
-            tok = parse_expr(ex->m_value);
-        }
-        catch (domain_error &e)
-        {
-            tok = Token(e.what());
-        }
-        catch (logic_error &e)
-        {
-            cerr << e.what() << endl;
-        }
-        map_ref_cells[scell] = tok;
-    }
-}
+First line means 3 raws and 4 columns.
 
-// parses reference (e.g. A4)
-// indirect recursion via parse_expr
-Token Tokenizer::parse_reference(const pair<short, short> &coords) {
-    short row = coords.first;
-    short col = coords.second;
+Expected output:
+12      -4      3       Sample
+4       -16     -4      Spread
+Test    1       5       Sheet
 
-    string s = m_table[row][col];
-    string scell = get_cell_by_coords(coords);
+    Note: if header points to more lines than available, the missing lines
+    are treated as empty cells.
+*/
+// prints out command line options
+static void print_usage() {
+    cerr << "Usage: eltab [options] [table.elt]" << endl
+        << "  table.elt         file of the table, standard input if none"
+        << endl
+        << "  -j, --threads N   evaluate on N threads (0 - one per core)"
+        << endl
+        << "  --engine E        serial, levels, steal, demand or frames"
+        << endl
+        << "  --no-columns      evaluate copied down expressions one by one"
+        << endl
+        << "  --backend B       interp or jit (native code)" << endl
+        << "  --compile         evaluate by the sheet compiled ahead of time"
+        << endl
+        << "  --no-optimize     evaluate the expressions as they are written"
+        << endl
+        << "  --cols LIST       print out only the given columns (e.g. A,C)"
+        << endl
+        << "  --cse             evaluate the prefixes shared by expressions"
+        " once" << endl
+        << "  --int64           evaluate in 64-bit integers with overflow"
+        " checks" << endl
+        << "  --deadline-ms N   stop evaluating after N milliseconds" << endl
+        << "  --max-ops N       stop evaluating after N operations" << endl
+        << "  --stream K|auto   evaluate row by row keeping K rows before it"
+        << endl
+        << "  --convert FILE    write the table in the binary format" << endl
+        << "  --stats           print out evaluation statistics" << endl;
+}
 
-    if (map_ref_cells.find(scell) != map_ref_cells.end()) {
-        throw logic_error("Internal error: parse_reference()");
+// marks the columns of the comma separated list of their letters (as
+// in the references) to be printed out, returns false if the list is
+// malformed
+static bool parse_columns(const string &list, const short cols,
+    vector<bool> &output)
+{
+    output.assign(cols, false);
+    istringstream stream(list);
+    string name;
+    while (getline(stream, name, ',')) {
+        if (name.size() != 1) {
+            return false;
+        }
+        int col = (cols <= 26) ? name[0] - 'A' : name[0] - 'a';
+        if (col < 0 || col >= cols) {
+            return false;
+        }
+        output[col] = true;
     }
+    return !list.empty();
+}
 
-    map_ref_cells.emplace(make_pair(scell, Token()));
-    Token tok;
-
-    if (is_expression(s)) {
-        try
-        {
-            tok = parse_expr(s.substr(1)); // removing leading '='
+// evaluates the table by the compiled sheet, returns false if some cell
+// read by the expressions is malformed, such table is evaluated the
+// usual way
+static bool eval_compiled(const AotLibrary &library, const short rows,
+    const short cols, string **cells, vector<AotValue> &values)
+{
+    values.assign(static_cast<size_t>(rows) * cols,
+        AotValue{ Token::T_UNDEFINED, 0, 0 });
+    for (int idx : library.get_inputs()) {
+        if (idx < 0 || idx >= static_cast<int>(values.size())) {
+            return false;
         }
-        catch (domain_error &e)
-        {
-            tok = static_cast<string>(e.what());
+        const string &s = cells[idx / cols][idx % cols];
+        int num;
+        if (is_number(s) && get_int_by_str(s, num)) {
+            values[idx] = AotValue{ Token::T_NUMBER, 0,
+                static_cast<double>(num) };
+        }
+        else if (s.empty() || is_string_literal(s)) {
+            values[idx] = AotValue{ Token::T_STRING, idx, 0 };
+        }
+        else {
+            return false;
         }
     }
-    else if (is_number(s)) {
-        tok = stoi(s);
-    }
-    else if (is_string_literal(s)) {
-        tok = s.substr(1); // removing leading "'"
-    }
-    else if (s.empty()) {
-        tok = string();
-    }
-    else {
-        throw domain_error("E_WRONG_REF");
-    }
-
-    map_ref_cells[scell] = tok;
-
-    return tok;
+    library.eval(values.data());
+    return true;
 }
 
-// calculates the product of two numeric operands
-Token Tokenizer::evaluate(vector<Token> &toks, const oper op) const {
-    Token right = toks.back();
-    toks.pop_back();
-    Token left = toks.back();
-    toks.pop_back();
-
-    if (left.type != Token::T_NUMBER || right.type != Token::T_NUMBER) {
-        throw domain_error("#E_UNEXP_EXPR");
+// returns the value evaluated by the compiled sheet for printing out
+static string get_compiled_value(const AotValue &value, const short cols,
+    string **cells)
+{
+    switch (value.tag) {
+    case Token::T_NUMBER:
+        return to_string(static_cast<int>(value.num));
+    case Token::T_STRING: {
+        const string &s = cells[value.aux / cols][value.aux % cols];
+        return s.empty() ? s : s.substr(1);
     }
-
-    switch (op) {
-    case OP_ADD: left.n_value += right.n_value;
-        break;
-    case OP_SUB: left.n_value -= right.n_value;
-        break;
-    case OP_MUL: left.n_value *= right.n_value;
-        break;
-    case OP_DIV: left.n_value /= right.n_value;
-        if (isinf(left.n_value)) { // detecting division by zero
-            throw domain_error("#E_INFINITE");
-        }
-        break;
+    case Token::T_ERROR:
+        return get_error_str(static_cast<err_code>(value.aux));
     default:
-        throw domain_error("#E_UNKNOWN_OP");
+        return string();
     }
-    left.n_value = static_cast<int>(left.n_value);
-
-    return left;
 }
 
-// Parses expression using reduced reverse polish notation algorithm.
-// No parenthesis, all operations' priorities are equal.
-// Briefly: adding two number tokens to the stack and evaluate them
-// immediately when operator appears. In case of reference identifier
-// we traverse the chain of references recursively checking if the
-// reference, being processed, is not already visited which means
-// direct or indirect cross-reference access which results in exception
-// See throw domain_error("#E_CROSS_REF") below.
-Token Tokenizer::parse_expr(const string &str) {
-    vector<Token> toks; // number tokens
-    oper op(OP_NONE); // current operator
-    Token tok;
-
-    for (string::const_iterator it = str.begin(); it != str.end(); ++it) {
-        if (is_operator(*it)) { // processing operators
-            if (op != OP_NONE || toks.empty()) {
-                throw domain_error("#E_UNEXP_SYMBOL");
+int main(int argc, char *argv[])
+{
+    Options opts;
+    string columns; // list of the columns printed out
+    string path;    // file of the table, standard input if empty
+    bool stream = false;    // evaluate row by row as the rows are read
+    int window = -1;        // rows kept for --stream, -1 - find it out
+    string convert; // binary table written instead of the evaluation
+
+    for (int a = 1; a < argc; a++) {
+        string arg = argv[a];
+        if ((arg == "-j" || arg == "--threads") && a + 1 < argc) {
+            int n = atoi(argv[++a]);
+            if (n < 0) {
+                print_usage();
+                return 1;
+            }
+            opts.threads = (n == 0) ?
+                max(thread::hardware_concurrency(), 1u) : n;
+        }
+        else if (arg == "--engine" && a + 1 < argc) {
+            string name = argv[++a];
+            if (name == "serial") {
+                opts.engine = Options::ENGINE_SERIAL;
+            }
+            else if (name == "levels") {
+                opts.engine = Options::ENGINE_LEVELS;
+            }
+            else if (name == "steal") {
+                opts.engine = Options::ENGINE_STEALING;
+            }
+            else if (name == "demand") {
+                opts.engine = Options::ENGINE_DEMAND;
+            }
+            else if (name == "frames") {
+                opts.engine = Options::ENGINE_FRAMES;
             }
             else {
-                op = get_operator(*it);
+                print_usage();
+                return 1;
             }
         }
-        else if (isdigit(*it)) { // processing numbers
-            toks.push_back(get_number_by_str(it, str));
-            if (toks.size() == 2 && op != OP_NONE && op != OP_UNKNOWN) {
-                tok = evaluate(toks, op);
-                toks.push_back(tok);
-                op = OP_NONE;
+        else if (arg == "--backend" && a + 1 < argc) {
+            string name = argv[++a];
+            if (name == "interp") {
+                opts.backend = Options::BACKEND_INTERP;
             }
-        }
-        else if (is_ref_candidate(*it)) { // processing references
-            // e.g. "B7" => col=1
-            short col = get_col_by_char(*it);
-            ++it;
-            // e.g. "A3" => row=2
-            short row = get_number_by_str(it, str) - 1;
-
-            // reference index is out of bound
-            if (row + 1 > m_rows || row < 0) {
-                throw domain_error("#E_INVALID_REF");
-            }
-
-            pair<short, short> coords = make_pair(row, col);
-
-            string scell = get_cell_by_coords(coords);
-            if (map_ref_cells.find(scell) != map_ref_cells.end()) {
-                if (map_ref_cells[scell].is_incomplete()) {
-                    throw domain_error("#E_CROSS_REF");
-                }
-                else {
-                    tok = map_ref_cells[scell];
-                }
+            else if (name == "jit") {
+                opts.backend = Options::BACKEND_JIT;
             }
             else {
-                tok = parse_reference(coords);
+                print_usage();
+                return 1;
             }
-
-            toks.push_back(tok);
-            if (toks.size() == 2 && op != OP_NONE && op != OP_UNKNOWN) {
-                tok = evaluate(toks, op);
-                toks.push_back(tok);
-                op = OP_NONE;
+        }
+        else if (arg == "--compile") {
+            opts.compile = true;
+        }
+        else if (arg == "--no-optimize") {
+            opts.optimize = false;
+        }
+        else if (arg == "--cols" && a + 1 < argc) {
+            columns = argv[++a];
+        }
+        else if (arg == "--cse") {
+            opts.cse = true;
+        }
+        else if (arg == "--int64") {
+            opts.int64 = true;
+        }
+        else if (arg == "--deadline-ms" && a + 1 < argc) {
+            int n = atoi(argv[++a]);
+            if (n <= 0) {
+                cerr << "Error: --deadline-ms needs a positive number of"
+                    " milliseconds" << endl;
+                return 1;
+            }
+            opts.deadline_ms = n;
+        }
+        else if (arg == "--max-ops" && a + 1 < argc) {
+            long long n = atoll(argv[++a]);
+            if (n <= 0) {
+                cerr << "Error: --max-ops needs a positive number of"
+                    " operations" << endl;
+                return 1;
             }
+            opts.max_ops = static_cast<size_t>(n);
         }
-        else { // all other tokens are considered as unexpected (malformed)
-            throw domain_error("#E_UNEXP_SYMB");
+        else if (arg == "--stream" && a + 1 < argc) {
+            string k = argv[++a];
+            stream = true;
+            window = (k == "auto") ? -1 : atoi(k.c_str());
+            if (k != "auto" && (k.empty() || !is_number(k))) {
+                print_usage();
+                return 1;
+            }
+        }
+        else if (arg == "--convert" && a + 1 < argc) {
+            convert = argv[++a];
+        }
+        else if (arg == "--no-columns") {
+            opts.columns = false;
+        }
+        else if (arg == "--stats") {
+            opts.stats = true;
+        }
+        else if (arg[0] != '-' && path.empty()) {
+            path = arg;
+        }
+        else {
+            print_usage();
+            return 1;
         }
-    } // for
-
-    // case when expression contains only one token (e.g. =1)
-    if (toks.size() == 1) {
-        tok = toks.back();
+    }
+    // the compiled sheet computes in double only and can't be stopped
+    if (opts.int64 || opts.deadline_ms > 0 || opts.max_ops > 0 || stream) {
+        opts.compile = false;
+    }
+    // the binary table keeps the programs as they are compiled
+    if (!convert.empty()) {
+        opts.compile = false;
+        opts.optimize = false;
+        stream = false;
+    }
+    // the window is found out from the whole table before the evaluation
+    if (stream && window < 0 && path.empty()) {
+        cerr << "Error: --stream auto needs the file of the table" << endl;
+        return 1;
     }
 
-    return tok;
-}
-
-/* 1. gets standard input (e.g. from text file)
-   2. fills out the table (cells) with raw values
-   3. runs evaluation process (calculating expressions and resolving
-      references)
-   4. prints out the results
-
-   Executable with args example: eltab.exe < $(TargetDir)\test.elt
-   Example of the contents of the test.elt (cells are tab-delimited):
-
-3	4
-12 =C2	3	'Sample
-=A1+B1*C1/5 =A2*B1 =B3-C3	'Spread
-'Test	=4-3	5	'Sheet
-
-First line means 3 raws and 4 columns.
-
-Expected output:
-12      -4      3       Sample
-4       -16     -4      Spread
-Test    1       5       Sheet
-
-    Note: if header points to more lines than available, the missing lines
-    are treated as empty cells.
-*/
-int main()
-{
     // set verbose to true to the see warning messages appearing in case of
     // inconsistency between table header (rows, cols) and real number of
     // rows and columns in the table
@@ -217,91 +289,235 @@ int main()
     // the table is just expanded with epty values
     bool verbose = false;
 
-    string line;
-    string data;
-    
-    // 1. getting standard input
-    getline(cin, line);
-
-    // reading number of lines/columns
-    istringstream linestream(line);
+    // 1. getting the input, the lines and the cells are the views into
+    // it and only the cells kept in the table are copied
+    InputText input;
+    if (path.empty() && stream) {
+        input.read_lines(cin, 0); // the rest is read as it's evaluated
+    }
+    else if (path.empty()) {
+        input.read(cin);
+    }
+    else if (!input.open(path)) {
+        cerr << "Error: Can't open " << path << endl;
+        return 1;
+    }
+    BinaryTable binary(input);
+    string error;
+    if (binary.is_binary() && stream) {
+        cerr << "Error: --stream needs the table in the text format" << endl;
+        return 1;
+    }
+    if (binary.is_binary() && !binary.validate(error)) {
+        cerr << "Error: Malformed binary table: " << error << endl;
+        return 1;
+    }
+    TableScanner scanner(input, 0, input.lines_end());
     short n_cols = 0, n_rows = 0;
-    linestream >> n_rows;
-    linestream >> n_cols;
     short i = 0, j = 0;
 
+    if (binary.is_binary()) {
+        // the compiled sheet is looked for by the text of the expressions
+        opts.compile = false;
+        n_rows = binary.get_rows();
+        n_cols = binary.get_cols();
+    }
+    else {
+        TextView line;
+        scanner.get_line(line);
+
+        // reading number of lines/columns
+        istringstream linestream(line.to_string());
+        linestream >> n_rows;
+        linestream >> n_cols;
+    }
+
     if (n_rows <= 0 || n_cols <= 0) {
         cerr << "Error: Incorrect table header: rows=" << n_rows <<", cols="
             << n_cols << endl;
         return 1;
     }
 
+    vector<bool> output;
+    if (!columns.empty() && !parse_columns(columns, n_cols, output)) {
+        print_usage();
+        return 1;
+    }
+    // the compiled sheet evaluates all the expressions whatever is printed
+    if (!opts.compile) {
+        opts.output = output;
+    }
+
+    // the expressions referencing the later rows can't be streamed, such
+    // table is evaluated as the whole
+    if (stream && window < 0) {
+        window = Stream::find_window(input, scanner.get_pos(),
+            input.size(), n_rows, n_cols);
+        stream = window >= 0;
+        if (opts.stats) {
+            cerr << "stream: " << (stream ? "window of " +
+                to_string(window) + " rows" : "not used") << endl;
+        }
+    }
+    if (stream) {
+        Stream streamer(n_rows, n_cols,
+            static_cast<short>(min(window, n_rows - 1)), opts, verbose);
+        streamer.add_lines(input, scanner.get_pos(), input.lines_end());
+        while (path.empty() && input.read_lines(cin, input.lines_end())) {
+            streamer.add_lines(input, 0, input.lines_end());
+        }
+        streamer.finish();
+        if (opts.stats) {
+            cerr << "optimizer: " << streamer.get_removed()
+                << " instructions removed" << endl;
+            cerr << "stream: " << streamer.get_outside()
+                << " references out of the window" << endl;
+        }
+        return 0;
+    }
+
     string **cells = new string*[n_rows];
     for (i = 0; i < n_rows; i++)
         cells[i] = new string[n_cols];
 
-    vector<Expr*> expressions;
-    i = 0;
-    // 2. filling out the table with raw data
-    while (getline(cin, line))
-    {
-        if (i == n_rows) {
-            if (verbose) {
-                cerr << "Warning: More lines than expected."
-                    "Skipping the remaining lines" << endl;
+    vector<Expr> expressions;
+    Compiler compiler(n_rows, n_cols);
+    Optimizer optimizer;
+    ShapeTable shapes;
+    Program program;
+    FormulaHash hash(n_rows, n_cols);
+    // 2. filling out the table with raw data, the chunks of the lines
+    // are filled out in parallel, the binary table is filled out from its
+    // columns and programs
+    if (binary.is_binary()) {
+        if (!binary.load(cells, expressions, shapes, optimizer,
+            opts.optimize, error)) {
+            cerr << "Error: Malformed binary table: " << error << endl;
+            return 1;
+        }
+    }
+    else {
+        TableLoader loader(input, n_rows, n_cols, cells, opts.compile,
+            opts.optimize, verbose);
+        loader.load(scanner.get_pos(), opts.threads, expressions, shapes,
+            optimizer);
+    }
+    if (!convert.empty()) {
+        if (!BinaryTable::write(convert, n_rows, n_cols, cells,
+            expressions, shapes)) {
+            cerr << "Error: Can't write " << convert << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (opts.compile) {
+        // the expressions are hashed in the order of the table
+        for (i = 0; i < n_rows; i++) {
+            for (j = 0; j < n_cols; j++) {
+                if (is_expression(cells[i][j])) {
+                    hash.add(i * n_cols + j, cells[i][j]);
+                }
             }
-            break;
         }
+    }
 
-        if (verbose) {
-            int cols_count = count_if(line.begin(), line.end(), isspace) + 1;
-            if (cols_count > n_cols) {
-                cerr << "Warning: Extra columns detected in line #" << i + 1
-                    << " Skipping..." << endl;
+    // 3. parsing and evaluating cells
+    // the compiled sheet is looked for by the hash of the expressions,
+    // if there is none the table is evaluated the usual way and the
+    // sheet is compiled for the next runs
+    AotLibrary library;
+    vector<AotValue> values;
+    string library_path;
+    bool loaded = false, compiled = false, built = false;
+    if (opts.compile) {
+        library_path = get_cache_path(hash.to_string());
+        loaded = !library_path.empty() && library.load(library_path);
+        compiled = loaded &&
+            eval_compiled(library, n_rows, n_cols, cells, values);
+        if (!compiled) {
+            for (i = 0; i < n_rows; i++) {
+                for (j = 0; j < n_cols; j++) {
+                    if (is_expression(cells[i][j])) {
+                        compiler.compile(cells[i][j], i * n_cols + j,
+                            program);
+                        if (opts.optimize) {
+                            optimizer.optimize(program);
+                        }
+                        expressions.push_back(Expr(make_pair(i, j),
+                            shapes.intern(program)));
+                        cells[i][j] = "=";
+                    }
+                }
             }
         }
-        
-        istringstream linestream(line);
-        while (getline(linestream, data, '\t'))
-        {
-            if (j > n_cols - 1) break;
+    }
 
-            if (is_expression(data)) {
-                expressions.push_back(new Expr(make_pair(i, j),
-                    data.substr(1)));
-                cells[i][j] = data;
-            }
-            else if (data.empty() || is_number(data) ||
-                is_string_literal(data)) {
-                cells[i][j] = data;
-            }
-            else { // marking unsupported cells by error msg
-                cells[i][j] = "#E_UNKNOWN";
-            }
-            j++;
+    unique_ptr<Tokenizer> tokenizer;
+    if (!compiled) {
+        tokenizer.reset(new Tokenizer(n_rows, n_cols, cells, expressions,
+            shapes));
+        tokenizer->run(opts);
+        if (opts.compile && !loaded && !library_path.empty()) {
+            string source = tokenizer->generate_source();
+            built = !source.empty() && build_library(source, library_path);
         }
-        j = 0;
-        i++;
     }
 
-    // 3. parsing and evaluating cells
-    Tokenizer tokenizer(n_rows, n_cols, cells, expressions);
-    tokenizer.run();
+    if (opts.stats && opts.compile) {
+        cerr << "compiled sheet: " << (compiled ? "used " :
+            (built ? "built " : "not used ")) << library_path << endl;
+    }
+    if (opts.stats && tokenizer) {
+        cerr << "shapes: " << shapes.size() << " distinct, "
+            << expressions.size() << " expressions" << endl;
+        cerr << "optimizer: " << optimizer.get_removed()
+            << " instructions removed, " << tokenizer->get_dead_cells()
+            << " cells not evaluated" << endl;
+        if (tokenizer->is_exceeded()) {
+            cerr << "budget: exceeded, the rest is #E_TIMEOUT" << endl;
+        }
+        cerr << "type inference: " << tokenizer->get_resolved_cells()
+            << " cells resolved, " << tokenizer->get_numeric_cells()
+            << " cells numeric" << endl;
+        cerr << "shared prefixes: " << tokenizer->get_shared_prefixes()
+            << ", " << tokenizer->get_shared_ops()
+            << " operations not evaluated again" << endl;
+        cerr << "column kernel: " << tokenizer->get_column_runs()
+            << " runs, " << tokenizer->get_column_cells() << " cells" << endl;
+        cerr << "native code: " << tokenizer->get_native_shapes()
+            << " shapes, " << tokenizer->get_native_size() << " bytes"
+            << endl;
+        const vector<WorkerStats> &workers = tokenizer->get_worker_stats();
+        for (size_t w = 0; w < workers.size(); w++) {
+            cerr << "worker " << w << ": executed " << workers[w].executed
+                << ", steals " << workers[w].steals << ", waits "
+                << workers[w].waits << ", backoffs " << workers[w].backoffs
+                << endl;
+        }
+    }
 
     // 4. printing out the results
     for (i = 0; i < n_rows; i++) {
         for (j = 0; j < n_cols; j++) {
+            if (!output.empty() && !output[j])
+                continue;
             if (is_string_literal(cells[i][j]))
                 cout << cells[i][j].substr(1) << '\t';
+            else if (is_expression(cells[i][j]) && compiled)
+                cout << get_compiled_value(values[i * n_cols + j], n_cols,
+                    cells) << '\t';
             else if (is_expression(cells[i][j]))
-                cout << tokenizer.get_value(make_pair(i, j)) << '\t';
+                cout << tokenizer->get_value(make_pair(i, j)) << '\t';
             else
                 cout << cells[i][j] << '\t';
         }
         cout << endl;
-        delete[] cells[i];
     }
 
+    // the values of the compiled sheet refer to the strings of any row
+    for (i = 0; i < n_rows; i++) {
+        delete[] cells[i];
+    }
     delete[] cells;
 
     return 0;
@@ -4,6 +4,17 @@
 #include <algorithm>
 #include <unordered_map>
 #include <sstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+#include "program.h"
+#include "graph.h"
+#include "jit.h"
+#include "checked.h"
+#include "budget.h"
 
 using namespace std;
 
@@ -11,24 +22,24 @@ using namespace std;
 // Utility functions
 //*********************************************
 // checks that string represents a string literal
-static bool is_string_literal(const string& s) {
+inline bool is_string_literal(const string& s) {
     return s[0] == '\'';
 }
 
 // checks that string represents an expression
-static bool is_expression(const string& str) {
+inline bool is_expression(const string& str) {
     return str[0] == '=';
 }
 
 // checks that string represents a positive number
-static bool is_number(const string& s)
+inline bool is_number(const string& s)
 {
     return !s.empty() && find_if(s.begin(), s.end(), [](const char c) {
         return !isdigit(c); }) == s.end();
 }
 
 // returns alpha-numeric value of the cell represented as coordinates
-static string get_cell_by_coords(const pair<short, short> &coords)
+inline string get_cell_by_coords(const pair<short, short> &coords)
 {
     short row = coords.first;
     short col = coords.second;
@@ -43,13 +54,44 @@ static string get_cell_by_coords(const pair<short, short> &coords)
     return c + to_string(row + 1);
 }
 
-// returns numeric value represented by the string
-// it's used when parsing a reference
-static int get_number_by_str(string::const_iterator &it, const string &str) {
+// converts the string of digits into int value,
+// returns false if the value doesn't fit int
+inline bool get_int_by_str(const string &s, int &num)
+{
+    long long val = 0;
+    for (const char c : s) {
+        val = val * 10 + (c - '0');
+        if (val > numeric_limits<int>::max()) {
+            return false;
+        }
+    }
+    num = static_cast<int>(val);
+    return true;
+}
+
+// converts the string of digits into 64-bit value,
+// returns false if the value doesn't fit it
+inline bool get_int64_by_str(const string &s, long long &num)
+{
+    const long long max = numeric_limits<long long>::max();
+    long long val = 0;
+    for (const char c : s) {
+        if (val > (max - (c - '0')) / 10) {
+            return false;
+        }
+        val = val * 10 + (c - '0');
+    }
+    num = val;
+    return true;
+}
+
+// returns numeric value represented by the digits starting at it and
+// leaves it at the last of them; it's used when parsing a reference
+inline int get_number_by_str(const char *&it, const char *end) {
     int num = 0;
-    while (it != str.end()) {
+    while (it != end) {
         num = *it - '0' + num * 10;
-        if ((it + 1) == str.end() || !isdigit(*(it + 1))) {
+        if ((it + 1) == end || !isdigit(*(it + 1))) {
             break;
         }
         ++it;
@@ -62,108 +104,396 @@ static int get_number_by_str(string::const_iterator &it, const string &str) {
 //*********************************************
 
 // represents an expression, one of the cells type
-// e.g. =1+2
+// e.g. =1+2, compiled at load time into the shape (see ShapeTable)
 struct Expr {
     pair<short, short> m_coords;
-    string m_value;
-    Expr(const pair<short, short> &coords, const string& value) :
-        m_coords(coords), m_value(value) {}
+    int m_shape;
+    Expr(const pair<short, short> &coords, const int shape) :
+        m_coords(coords), m_shape(shape) {}
+};
+
+// id of the string kept in StringPool
+enum str_id : int { STR_EMPTY = 0 };
+
+// Set of the distinct strings of the cells, each is stored once and
+// referred to by its id, so the tokens never copy the strings
+class StringPool {
+    unordered_map<string, str_id> m_ids;
+    vector<const string*> m_strings;    // strings indexed by id
+    mutex m_mutex;                      // the cells are parsed on demand
+                                        // by several threads
+
+public:
+    // ctor, the empty string is there from the start
+    StringPool() {
+        intern(string());
+    }
+
+    // returns id of the string, adds it if it is new
+    str_id intern(const string &s) {
+        lock_guard<mutex> lock(m_mutex);
+        auto it = m_ids.find(s);
+        if (it == m_ids.end()) {
+            it = m_ids.emplace(s,
+                static_cast<str_id>(m_strings.size())).first;
+            m_strings.push_back(&it->first);
+        }
+        return it->second;
+    }
+
+    // string with the given id
+    const string& get(const str_id id) const {
+        return *m_strings[id];
+    }
 };
 
 // Represents a valid token which is either number
-// or string (inluding empty cells)
+// or string (inluding empty cells) or error of the evaluation.
+// The number is T_NUMBER kept as double and truncated to int after each
+// operation or T_INTEGER kept as 64-bit integer in the integer mode
+// (see Options::int64), the two never meet in one table.
+// The token takes 16 bytes and is copied as plain memory: the string is
+// kept in StringPool and the token has only its id.
 struct Token {
-    enum { T_UNDEFINED, T_NUMBER, T_STRING } type;
+    enum { T_UNDEFINED, T_NUMBER, T_STRING, T_ERROR, T_INTEGER } type;
 
-    double n_value;
-    string s_value;
+    union {
+        double n_value;
+        long long i_value;
+        str_id s_value;
+        err_code e_value;
+    };
 
     // ctors for different token types
-    Token() : type(T_UNDEFINED) { }
-    Token(const int val) : type(T_NUMBER) { n_value = val; }
-    Token(const string &val) : s_value(val), type(T_STRING) { }
+    Token() : type(T_UNDEFINED), n_value(0) { }
+    Token(const int val) : type(T_NUMBER), n_value(val) { }
+    Token(const long long val) : type(T_INTEGER), i_value(val) { }
+    Token(const str_id id) : type(T_STRING), s_value(id) { }
+    Token(const err_code code) : type(T_ERROR), e_value(code) { }
 
-    // get string representation of the token
-    string to_string() const {
-        return (type == T_NUMBER) ?
-            std::to_string(static_cast<int>(n_value)) : s_value;
+    // get string representation of the token, the strings are taken
+    // from the pool
+    string to_string(const StringPool &strings) const {
+        switch (type) {
+        case T_NUMBER: return std::to_string(static_cast<int>(n_value));
+        case T_INTEGER: return std::to_string(i_value);
+        case T_ERROR: return get_error_str(e_value);
+        case T_STRING: return strings.get(s_value);
+        default: return string();
+        }
     }
+};
+
+// type of the value of the cell known at load time (see
+// Tokenizer::infer_type()), VT_ANY if it may be of several types
+enum value_type : unsigned char { VT_ANY, VT_NUMBER, VT_STRING, VT_ERROR };
+
+// kind of the program for the type inference
+enum program_kind : unsigned char {
+    PK_OTHER,       // has other instructions or leaves other than one
+                    // operand
+    PK_SAFE,        // numbers, references and operators, gives a number
+                    // when the references are numbers
+    PK_MAY_FAIL     // the same, but may fail (division by the reference)
+};
+
+// returns the kind of the program
+program_kind get_program_kind(const Program &prog);
+
+// Evaluated value of a cell together with its evaluation state.
+// The state is used while the evaluation order is being worked out:
+// a cell in progress belongs to the component of the cells referencing
+// each other which is not complete yet (see Tokenizer::sort()), S_DONE
+// means the cell has got its place in order or its value.
+struct CellValue {
+    enum { S_UNVISITED, S_IN_PROGRESS, S_DONE } state;
+    Token value;
+
+    CellValue() : state(S_UNVISITED) { }
+};
+
+// options of the evaluation process (see main())
+struct Options {
+    // engines evaluating the expressions
+    enum engine_t {
+        ENGINE_AUTO,        // serial for one thread, levels otherwise
+        ENGINE_SERIAL,      // one by one in order
+        ENGINE_LEVELS,      // level by level in parallel
+        ENGINE_STEALING,    // dataflow with work stealing
+        ENGINE_DEMAND,      // on demand without the order worked out
+        ENGINE_FRAMES       // resumable frames waiting for the cells
+    };
 
-    // indicates that the token is being processed;
-    // this is used to detect possible cross-references between cells
-    // containing references (e.g. A1->B2->A1)
-    bool is_incomplete() { return type == T_UNDEFINED; }
+    // backends evaluating one expression
+    enum backend_t {
+        BACKEND_AUTO,       // native code for the shapes used by many cells
+        BACKEND_INTERP,     // interpreter of the programs
+        BACKEND_JIT         // native code wherever possible
+    };
+
+    unsigned threads;       // number of evaluation threads
+    engine_t engine;        // engine evaluating the expressions
+    backend_t backend;      // backend evaluating one expression
+    bool columns;           // evaluate copied down expressions by kernel
+    bool compile;           // evaluate by the sheet compiled ahead of time
+    bool optimize;          // optimize the compiled expressions
+    bool cse;               // evaluate shared prefixes of expressions once
+    bool int64;             // evaluate in 64-bit integers
+    bool stats;             // print out statistics of the evaluation
+    // columns printed out (all if empty), the expressions which are not
+    // printed out or referenced by the printed ones are not evaluated
+    vector<bool> output;
+    // budget of the evaluation, the expressions not evaluated within it
+    // get #E_TIMEOUT (see Budget)
+    unsigned deadline_ms;   // milliseconds from the start, 0 - no limit
+    size_t max_ops;         // operations, 0 - no limit
+    const CancelToken *cancel;  // token cancelling the evaluation or nullptr
+
+    Options() : threads(1), engine(ENGINE_AUTO), backend(BACKEND_AUTO),
+        columns(true), compile(false), optimize(true), cse(false),
+        int64(false), stats(false), deadline_ms(0), max_ops(0),
+        cancel(nullptr) { }
+};
+
+// counters of one worker of the work stealing, on demand or frames engine
+struct WorkerStats {
+    size_t executed;        // expressions evaluated
+    size_t steals;          // tasks taken from other workers
+    size_t waits;           // waits (suspensions) for the cells of others
+    size_t backoffs;        // cells released to break the circle of waits
+
+    WorkerStats() : executed(0), steals(0), waits(0), backoffs(0) { }
 };
 
 // The root class managing all the process of table evaluation
 class Tokenizer {
-    // enumerates supported operators ('+', '-', '*', '/')
-    typedef enum { OP_NONE, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_UNKNOWN } oper;
-
     short m_cols;                   // number of columns in table
     short m_rows;                   // number of rows(lines) in table
     string** m_table;               // source table with raw data
-    vector<Expr*> m_expressions;    // set of expressions (cell started with '=')
-
-    // hashtable for cashing traversed cell references
-    // used to avoid recurrring traversal of the cell
-    unordered_map<string, Token> map_ref_cells;
-
-    // checks that the char starts correct cell reference from the available
-    // range of cells
-    bool is_ref_candidate(const char c) const {
-        return ((m_cols <= 26 && (c >= 'A' && c <= 'A' + (m_cols - 1))) ||
-            (m_cols > 26 && m_cols <= 52 && (c >= 'a' &&
-                c <= 'a' + (m_cols - 26 - 1))));
-    }
-
-    // returns column number by alfabhetic representation
-    short get_col_by_char(const char c) const
-    {
-        return (m_cols <= 26) ? c - 'A' : ((m_cols > 26 && m_cols <= 52) ?
-            c - 'a' : -1);
-    }
-
-    // returns operator enum value by symbol
-    static oper get_operator(const char ch)
-    {
-        switch (ch) {
-        case '*': return OP_MUL;
-        case '/': return OP_DIV;
-        case '+': return OP_ADD;
-        case '-': return OP_SUB;
-        default: return OP_UNKNOWN;
+    vector<Expr> m_expressions;     // set of expressions (cell started with '=')
+    const ShapeTable &m_shapes;     // programs of the expressions
+
+    StringPool m_strings;           // strings of the cells
+    bool m_int64;                   // numbers are 64-bit integers
+    bool m_resolve;                 // expressions known to fail get their
+                                    // errors at load time (not with
+                                    // --compile, see infer_type())
+    Budget m_budget;                // budget of the current evaluation
+
+    // flat store for cashing traversed cell references indexed by
+    // row * m_cols + col; used to avoid recurrring traversal of the cell
+    vector<CellValue> m_cells;
+
+    // compiled expressions of the cells indexed as m_cells,
+    // nullptr for the cells which are not expressions
+    vector<const Program*> m_programs;
+
+    DepGraph m_graph;               // references between the cells
+    vector<int> m_order;            // expression cells in evaluation order
+
+    // for each cell the position in its program where evaluation stops
+    // with the error known at load time (-1 if there is no such position),
+    // e.g. reference to malformed cell
+    vector<pair<int, err_code>> m_stops;
+
+    // order of the visit and the lowest order of the cells reachable
+    // from the cell in progress, used to find the cycles (see sort())
+    vector<int> m_visit;
+    vector<int> m_low;
+
+    // counters of the workers of the last work stealing or on demand run
+    vector<WorkerStats> m_worker_stats;
+
+    size_t m_column_runs;           // runs evaluated by the column kernel
+    size_t m_column_cells;          // cells evaluated by the column kernel
+
+    // shapes used by this number of cells evaluated one by one are
+    // compiled into native code by BACKEND_AUTO
+    static const int HOT_SHAPE = 64;
+
+    NativeCode m_native_code;       // native code of the shapes
+    // native functions of the cells, empty if there is no native code
+    vector<NativeCode::function_t> m_native;
+    size_t m_native_shapes;         // shapes compiled into native code
+    size_t m_dead_cells;            // expressions never evaluated
+
+    // prefix of the expressions shared by several of them (see
+    // share_prefixes()), evaluated once by its owner
+    struct SharedPrefix {
+        Program prefix;             // instructions relative to the owner
+        int owner;                  // expression evaluating the prefix
+        Token value;                // value of the prefix
+    };
+    vector<SharedPrefix> m_prefixes;
+    // for each cell the shared prefix it starts with and the position in
+    // its program following it, empty if no prefix is shared
+    vector<pair<int, int>> m_shared;
+    size_t m_shared_ops;            // operations not evaluated again
+
+    // kinds of the programs of the cells and types of the expressions
+    // put in order (see infer_type())
+    vector<program_kind> m_kinds;
+    vector<value_type> m_types;
+    // for each cell 1 if the expression references only the numbers
+    // and is evaluated without checking the types
+    vector<char> m_numeric;
+    size_t m_numeric_cells;         // expressions referencing only numbers
+    size_t m_resolved_cells;        // expressions resolved at load time
+
+    // returns the owner of the prefix shared by the cell which is not
+    // the cell itself, -1 if there is none
+    int get_prefix_owner(const int idx) const {
+        if (m_shared.empty() || m_shared[idx].first < 0) {
+            return -1;
         }
+        int owner = m_prefixes[m_shared[idx].first].owner;
+        return (owner != idx) ? owner : -1;
     }
 
-    // checks that the char is supported operator
-    static bool is_operator(const char ch) {
-        return OP_UNKNOWN != get_operator(ch);
+    // returns index of the cell in m_cells
+    size_t get_index(const pair<short, short> &coords) const {
+        return static_cast<size_t>(coords.first) * m_cols + coords.second;
     }
 
 public:
     // ctor
     Tokenizer(const short rows, const short cols, string** table,
-        const vector<Expr*> &expressions) : m_rows(rows), m_cols(cols),
-        m_table(table), m_expressions(expressions) {};
+        const vector<Expr> &expressions, const ShapeTable &shapes) :
+        m_cols(cols), m_rows(rows), m_table(table),
+        m_expressions(expressions), m_shapes(shapes), m_int64(false),
+        m_resolve(true),
+        m_cells(static_cast<size_t>(rows) * cols),
+        m_programs(m_cells.size(), nullptr), m_column_runs(0),
+        m_column_cells(0), m_native_shapes(0), m_dead_cells(0),
+        m_shared_ops(0), m_numeric_cells(0), m_resolved_cells(0) {
+        m_kinds.assign(m_cells.size(), PK_OTHER);
+        vector<int> kinds(m_shapes.size(), -1);
+        for (auto &expr : m_expressions) {
+            size_t idx = get_index(expr.m_coords);
+            m_programs[idx] = &m_shapes.get(expr.m_shape);
+            int &kind = kinds[expr.m_shape];
+            if (kind < 0) {
+                kind = get_program_kind(*m_programs[idx]);
+            }
+            m_kinds[idx] = static_cast<program_kind>(kind);
+        }
+        m_graph.build(m_programs);
+        m_stops.assign(m_cells.size(), make_pair(-1, E_NONE));
+        m_types.assign(m_cells.size(), VT_ANY);
+        m_numeric.assign(m_cells.size(), 0);
+        m_visit.resize(m_cells.size());
+        m_low.resize(m_cells.size());
+    };
 
-    virtual ~Tokenizer() {
-        for (auto &expr : m_expressions) { delete expr; }
-    }
+    virtual ~Tokenizer() { }
 
     // starts the process of the parsing/evaluation of expressions
-    void run();
+    void run(const Options &opts = Options());
+    // evaluates expressions level by level on the given number of threads
+    void run_levels(const unsigned threads);
+    // evaluates expressions as soon as the cells they reference are
+    // evaluated, on the given number of threads stealing work
+    void run_stealing(const unsigned threads);
+    // evaluates the given expressions and the ones they reference on
+    // the given number of threads claiming the cells as they get to them
+    void run_demand(const unsigned threads, const vector<int> &roots);
+    // evaluates the given expressions and the ones they reference as
+    // frames suspended while the cells they reference are not evaluated
+    void run_frames(const unsigned threads, const vector<int> &roots);
+    // evaluates the expressions copied down the columns at once by the
+    // column kernel and takes them out of the order
+    void run_columns();
+    // finds the prefixes of the expressions left in the order which
+    // several of them start with, so each is evaluated once
+    void share_prefixes();
+    // works out the type of the expression put in order, returns true
+    // if it is known to result in the error, which is its value then
+    bool infer_type(const int idx);
+    // compiles the shapes of the expressions left in the order into
+    // native code as the backend says
+    void compile_native(const Options::backend_t backend);
+    // evaluates one expression cell and stores its value
+    void eval_cell(const int idx);
                 
-    // parses one expression
-    Token parse_expr(const string &str);
-    // parses one refrence
-    Token parse_reference(const pair<short, short> &coords);
+    // works out the order of evaluation of the expressions starting from
+    // the given cells, the cells which are not unvisited are skipped;
+    // the cells in cycles and depending on them get #E_CROSS_REF
+    void sort(const vector<int> &roots);
+
+    // replaces the program of the cell (nullptr if the cell is not an
+    // expression any longer), its text is already changed in the table;
+    // the program is kept by the caller
+    void set_program(const int idx, const Program *program);
+    // reevaluates the given cells and the expressions they reference
+    // which are not evaluated, the other cells keep their values; only
+    // the budget and the integer mode of the options are used
+    void update(const vector<int> &cells, const Options &opts = Options());
+    // moves the rows below the given number of the top ones up to the
+    // top with their values, the rows left at the bottom are empty and
+    // unvisited; the rows of the table are moved by the caller
+    void shift_rows(const short rows);
+    // generates the source of the library evaluating the table the way
+    // run() does (see aot.h), empty if it can't be done
+    string generate_source() const;
+
+    // evaluates one compiled expression of the cell base, errors are
+    // returned as tokens; the evaluation may start at the position first
+    // with the value of the instructions before it as the only operand
+    Token execute(const Program &prog, const int base,
+        const pair<int, err_code> &stop, const size_t first = 0,
+        const Token &operand = Token()) const;
+    // evaluates one compiled expression which references only the
+    // numbers and has no stop, its operands are not checked
+    Token execute_numeric(const Program &prog, const int base) const;
+    // parses one refrence to the cell which is not an expression,
+    // returns false for malformed cell
+    bool parse_reference(const int idx);
+
+    // checks that the last evaluation ran out of its budget
+    bool is_exceeded() const {
+        return m_budget.is_exceeded();
+    }
+
+    // checks that the cell was not evaluated within the budget
+    bool is_timed_out(const int idx) const {
+        const Token &tok = m_cells[idx].value;
+        return tok.type == Token::T_ERROR && tok.e_value == E_TIMEOUT;
+    }
+
+    // checks that the cell is in a cycle or depends on one
+    bool is_cross_ref(const int idx) const {
+        const Token &tok = m_cells[idx].value;
+        return tok.type == Token::T_ERROR && tok.e_value == E_CROSS_REF;
+    }
 
     // calculates the product of two operands and one operator
-    Token evaluate(vector<Token> &toks, const oper op) const;
+    Token evaluate(const Token &left, const Token &right, const oper op) const;
+
+    // counters of the workers of the last work stealing or on demand run
+    const vector<WorkerStats>& get_worker_stats() const {
+        return m_worker_stats;
+    }
+
+    // number of runs and cells evaluated by the column kernel
+    size_t get_column_runs() const { return m_column_runs; }
+    size_t get_column_cells() const { return m_column_cells; }
+    // number of shapes and size of their native code
+    size_t get_native_shapes() const { return m_native_shapes; }
+    size_t get_native_size() const { return m_native_code.size(); }
+    // number of expressions which are not printed out or referenced by
+    // the printed ones and are not evaluated
+    size_t get_dead_cells() const { return m_dead_cells; }
+    // number of shared prefixes and of the operations which are not
+    // evaluated again thanks to them
+    size_t get_shared_prefixes() const { return m_prefixes.size(); }
+    size_t get_shared_ops() const { return m_shared_ops; }
+    // number of expressions resolved at load time and of the ones
+    // evaluated without checking the types
+    size_t get_resolved_cells() const { return m_resolved_cells; }
+    size_t get_numeric_cells() const { return m_numeric_cells; }
 
     // returns evaluated value for printing out
     string get_value(const pair<short, short> &coords) {
-        return map_ref_cells[get_cell_by_coords(coords)].to_string();
+        return m_cells[get_index(coords)].value.to_string(m_strings);
     }
 };
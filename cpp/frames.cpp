@@ -0,0 +1,154 @@
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include "eltab.h"
+#include "work_queue.h"
+
+// Evaluates the expressions as resumable frames without working out the
+// order first. The frame of the expression is the position of the next
+// reference it resolves (in the order of the references, see DepGraph);
+// it goes through the references and suspends at the expression which is
+// not evaluated yet, starting its frame if there is none. The frame is
+// put into the list of the frames waiting for that cell and is resumed
+// by the worker which evaluates the cell. When all the references are
+// resolved, the expression is evaluated. The frames take no stacks of
+// their own, so any number of them may be suspended while the workers
+// run the others (the ready frames are queued as in run_stealing()).
+// A reference to malformed cell stops the frame with E_WRONG_REF at that
+// point as it does in sort(). The frames still suspended when there are
+// no ready ones left wait for each other: their cells are in cycles or
+// depend on them and get #E_CROSS_REF, so the results are the same as of
+// serial evaluation.
+void Tokenizer::run_frames(const unsigned threads, const vector<int> &roots) {
+    const unsigned n_workers = max(threads, 1u);
+    // states of the cells, the cell which is not an expression is
+    // STARTED while it is being parsed
+    enum { NEW, STARTED, DONE, MALFORMED };
+    // number of the locks of the lists of waiting frames
+    const size_t LOCKS = 256;
+
+    unique_ptr<atomic<int>[]> states(new atomic<int>[m_cells.size()]);
+    for (size_t c = 0; c < m_cells.size(); c++) {
+        states[c].store((m_cells[c].state == CellValue::S_DONE) ? DONE : NEW,
+            memory_order_relaxed);
+    }
+    vector<const int*> frames(m_cells.size(), nullptr);
+    vector<vector<int>> waiting(m_cells.size());
+    vector<mutex> locks(LOCKS);
+
+    vector<WorkQueue> queues(n_workers);
+    m_worker_stats.assign(n_workers, WorkerStats());
+    // frames queued or running, none of the suspended frames can be
+    // resumed when there are none
+    atomic<size_t> active(0);
+
+    auto start = [&](const int cell, WorkQueue &queue) {
+        m_cells[cell].state = CellValue::S_IN_PROGRESS;
+        frames[cell] = m_graph.deps_begin(cell);
+        active.fetch_add(1, memory_order_acq_rel);
+        queue.push(cell);
+    };
+    unsigned next = 0;
+    for (int root : roots) {
+        int expected = NEW;
+        if (m_programs[root] != nullptr &&
+            states[root].compare_exchange_strong(expected, STARTED)) {
+            start(root, queues[next++ % n_workers]);
+        }
+    }
+
+    // resolves the cell which is not an expression, returns false for
+    // malformed cell
+    auto resolve_leaf = [&](const int leaf) {
+        int state = NEW;
+        if (states[leaf].compare_exchange_strong(state, STARTED,
+            memory_order_acq_rel)) {
+            state = parse_reference(leaf) ? DONE : MALFORMED;
+            states[leaf].store(state, memory_order_release);
+        }
+        while (state == STARTED) { // parsed by another worker
+            this_thread::yield();
+            state = states[leaf].load(memory_order_acquire);
+        }
+        return state == DONE;
+    };
+
+    // runs the frame until it suspends or its expression is evaluated
+    auto resume = [&](const int cell, WorkQueue &queue, WorkerStats &stats) {
+        const int *&dep = frames[cell];
+        for (; dep < m_graph.deps_end(cell); ++dep) {
+            if (states[*dep].load(memory_order_acquire) == DONE) {
+                continue;
+            }
+            if (m_programs[*dep] == nullptr) {
+                if (!resolve_leaf(*dep)) {
+                    size_t k = dep - m_graph.deps_begin(cell);
+                    m_stops[cell] = make_pair(
+                        m_programs[cell]->get_ref_pc(k), E_WRONG_REF);
+                    break;
+                }
+                continue;
+            }
+
+            int expected = NEW;
+            if (states[*dep].compare_exchange_strong(expected, STARTED,
+                memory_order_acq_rel)) {
+                start(*dep, queue);
+            }
+            lock_guard<mutex> lock(locks[*dep % LOCKS]);
+            if (states[*dep].load(memory_order_acquire) != DONE) {
+                waiting[*dep].push_back(cell);
+                stats.waits++;
+                return; // resumed when the cell is evaluated
+            }
+        }
+
+        eval_cell(cell);
+        stats.executed++;
+        m_cells[cell].state = CellValue::S_DONE;
+        vector<int> ready;
+        {
+            lock_guard<mutex> lock(locks[cell % LOCKS]);
+            states[cell].store(DONE, memory_order_release);
+            ready.swap(waiting[cell]);
+        }
+        active.fetch_add(ready.size(), memory_order_acq_rel);
+        for (int frame : ready) {
+            queue.push(frame);
+        }
+    };
+
+    auto worker = [&](const unsigned self) {
+        WorkerStats &stats = m_worker_stats[self];
+        int cell;
+        while (active.load(memory_order_acquire) > 0) {
+            bool found = queues[self].pop(cell);
+            for (unsigned i = 1; !found && i < n_workers; i++) {
+                found = queues[(self + i) % n_workers].steal(cell);
+                stats.steals += found;
+            }
+            if (!found) {
+                this_thread::yield();
+                continue;
+            }
+            resume(cell, queues[self], stats);
+            active.fetch_sub(1, memory_order_acq_rel);
+        }
+    };
+
+    vector<thread> helpers;
+    for (unsigned w = 1; w < n_workers; w++) {
+        helpers.push_back(thread(worker, w));
+    }
+    worker(0);
+    for (auto &t : helpers) { t.join(); }
+
+    for (size_t c = 0; c < m_cells.size(); c++) {
+        if (m_programs[c] != nullptr && states[c].load() == STARTED) {
+            m_cells[c].value = Token(E_CROSS_REF);
+            m_cells[c].state = CellValue::S_DONE;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#include "graph.h"
+
+// calls fn for each cell referenced by the program of the cell c
+template <class Fn>
+static void for_each_ref(const int c, const Program *program, Fn fn) {
+    if (program == nullptr) {
+        return;
+    }
+    for (const Instr &in : program->m_code) {
+        if (in.code == Instr::I_REF || in.code == Instr::I_TOUCH) {
+            fn(c + in.arg);
+        }
+    }
+}
+
+// builds the graph for the cells with the given programs
+void DepGraph::build(const vector<const Program*> &programs) {
+    m_begin.assign(programs.size(), 0);
+    m_end.assign(programs.size(), 0);
+    m_deps.clear();
+
+    for (size_t c = 0; c < programs.size(); c++) {
+        m_begin[c] = m_deps.size();
+        for_each_ref(static_cast<int>(c), programs[c], [&](const int dep) {
+            m_deps.push_back(dep);
+        });
+        m_end[c] = m_deps.size();
+    }
+}
+
+// replaces the references of the cell c by the ones of the program
+// the new references take the place of the old ones if they fit there,
+// otherwise they are appended
+void DepGraph::update(const int c, const Program *program) {
+    size_t count = 0;
+    for_each_ref(c, program, [&](const int) { count++; });
+
+    if (count > m_end[c] - m_begin[c]) {
+        m_begin[c] = m_deps.size();
+        m_deps.resize(m_deps.size() + count);
+    }
+    m_end[c] = m_begin[c];
+    for_each_ref(c, program, [&](const int dep) {
+        m_deps[m_end[c]++] = dep;
+    });
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "program.h"
+
+using namespace std;
+
+// Dependency graph of the table cells built once at load time from the
+// compiled expressions. The cells referenced by the cell c are kept in
+// compressed form: m_deps[m_begin[c] .. m_end[c]) in the order the
+// references appear in the expression (I_REF and I_TOUCH).
+class DepGraph {
+    vector<size_t> m_begin;     // start of the references of each cell
+    vector<size_t> m_end;       // end of the references of each cell
+    vector<int> m_deps;         // indices of the referenced cells
+
+public:
+    // builds the graph for the cells with the given programs
+    // (nullptr for the cells which are not expressions)
+    void build(const vector<const Program*> &programs);
+
+    // replaces the references of the cell c by the ones of the program
+    void update(const int c, const Program *program);
+
+    // cells referenced by the cell c
+    const int* deps_begin(const int c) const {
+        return m_deps.data() + m_begin[c];
+    }
+    const int* deps_end(const int c) const {
+        return m_deps.data() + m_end[c];
+    }
+
+    // number of cells in graph
+    size_t size() const {
+        return m_begin.size();
+    }
+};
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <fstream>
+
+#include "input.h"
+#include "kernels.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+InputText::~InputText() {
+    if (m_view == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m_view);
+    CloseHandle(static_cast<HANDLE>(m_mapping));
+#else
+    munmap(m_view, m_size);
+#endif
+}
+
+// maps the regular file of non-zero size, the empty one has nothing to
+// map and is read as any other
+bool InputText::map(const string &path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) ||
+        size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0,
+        nullptr);
+    CloseHandle(file); // the mapping keeps the file open
+    if (mapping == nullptr) {
+        return false;
+    }
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        return false;
+    }
+    m_mapping = mapping;
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void *view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+        MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    // the text is read once from the start to the end
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    m_size = static_cast<size_t>(st.st_size);
+#endif
+    m_view = view;
+    m_data = static_cast<const char*>(view);
+    m_lines_end = m_size;
+    return true;
+}
+
+bool InputText::open(const string &path) {
+    if (map(path)) {
+        return true;
+    }
+    ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    read(file);
+    return true;
+}
+
+// reads the stream in large blocks rather than line by line
+void InputText::read(istream &in) {
+    m_buffer.clear();
+    size_t size = 0;
+    for (;;) {
+        m_buffer.resize(size + BLOCK);
+        in.read(m_buffer.data() + size, BLOCK);
+        size += static_cast<size_t>(in.gcount());
+        if (!in) {
+            break;
+        }
+    }
+    m_buffer.resize(size);
+    m_data = m_buffer.data();
+    m_size = m_lines_end = size;
+}
+
+bool InputText::read_lines(istream &in, const size_t keep) {
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + min(keep, m_size));
+    size_t size = m_buffer.size();
+    size_t end = 0; // offset after the last line end, 0 if there is none
+    while (in && end == 0) {
+        m_buffer.resize(size + BLOCK);
+        in.read(m_buffer.data() + size, BLOCK);
+        size_t count = static_cast<size_t>(in.gcount());
+        for (size_t i = size + count; i > size && end == 0; i--) {
+            if (m_buffer[i - 1] == '\n') {
+                end = i;
+            }
+        }
+        size += count;
+    }
+    m_buffer.resize(size);
+    m_data = m_buffer.data();
+    m_size = size;
+    // the last line may have no line end once the stream ends
+    m_lines_end = (end == 0 || !in) ? size : end;
+    return size > 0;
+}
+
+// defined as min() takes it by reference
+const size_t TableScanner::BLOCK;
+
+bool TableScanner::scan_block() {
+    if (m_scanned >= m_end) {
+        return false;
+    }
+    m_block = m_scanned;
+    size_t size = min(BLOCK, m_end - m_block);
+    m_found = scan_delimiters(m_input.data() + m_block, size,
+        m_index.data());
+    m_next = 0;
+    m_scanned += size;
+    return true;
+}
+
+// takes the delimiters of the line from the index: the cell starts after
+// each '\t', the line ends at the '\n' or at the end of the part
+bool TableScanner::get_line(TextView &line) {
+    if (m_pos >= m_end) {
+        return false;
+    }
+    size_t begin = m_pos;
+    size_t end = m_end;
+    m_bounds.clear();
+    m_bounds.push_back(begin);
+    for (;;) {
+        while (m_next == m_found) {
+            if (!scan_block()) {
+                break;
+            }
+        }
+        if (m_next == m_found) {
+            break;
+        }
+        size_t delim = m_block + m_index[m_next++];
+        if (m_input.data()[delim] == '\n') {
+            end = delim;
+            break;
+        }
+        m_bounds.push_back(delim + 1);
+    }
+    m_pos = end + 1;
+#ifdef _WIN32
+    // the mapped text has the line ends the text mode strips off
+    if (m_input.is_mapped() && end > m_bounds.back() &&
+        m_input.data()[end - 1] == '\r') {
+        --end;
+    }
+#endif
+    // the empty last cell (of the empty line or after the trailing '\t')
+    // is not there, its start ends the cell before it
+    if (m_bounds.back() != end) {
+        m_bounds.push_back(end + 1);
+    }
+    line = TextView(m_input.data() + begin, end - begin);
+    return true;
+}
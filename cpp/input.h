@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+// Text of one line or cell inside the input, the text is copied only
+// for the cells which keep it (see InputText)
+struct TextView {
+    const char *data;
+    size_t size;
+
+    TextView() : data(nullptr), size(0) { }
+    TextView(const char *d, const size_t s) : data(d), size(s) { }
+
+    bool empty() const {
+        return size == 0;
+    }
+
+    // first char, '\0' if there is none (as string::operator[] gives)
+    char front() const {
+        return empty() ? '\0' : data[0];
+    }
+
+    string to_string() const {
+        return string(data, size);
+    }
+};
+
+// Whole input of the table: the file given by the path is mapped into
+// memory, other inputs (e.g. pipes) are read into the buffer at once.
+// The lines and the cells are the views into it, so the load doesn't
+// copy the text of the table.
+class InputText {
+    static const size_t BLOCK = 1 << 20;
+
+    const char *m_data;
+    size_t m_size;
+    size_t m_lines_end;             // offset after the last complete line
+    vector<char> m_buffer;          // text read from the stream
+    void *m_view;                   // mapped file or nullptr
+#ifdef _WIN32
+    void *m_mapping;                // handle of the mapping object
+#endif
+
+    // maps the file, returns false if it can't be mapped
+    bool map(const string &path);
+
+public:
+    InputText() : m_data(nullptr), m_size(0), m_lines_end(0),
+        m_view(nullptr)
+#ifdef _WIN32
+        , m_mapping(nullptr)
+#endif
+    { }
+    ~InputText();
+
+    InputText(const InputText&) = delete;
+    InputText& operator=(const InputText&) = delete;
+
+    // maps the file or reads it if it can't be mapped (e.g. a named
+    // pipe), returns false if it can't be opened
+    bool open(const string &path);
+    // reads the whole stream
+    void read(istream &in);
+    // reads the stream by blocks for the streaming evaluation: the text
+    // before the offset keep is dropped and the next block is read, with
+    // at least one line end unless the stream ends; returns false if
+    // there is no text left
+    bool read_lines(istream &in, const size_t keep);
+
+    // checks that the text is mapped rather than read
+    bool is_mapped() const {
+        return m_view != nullptr;
+    }
+
+    const char* data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    // offset after the last line end of the text read by read_lines(),
+    // the end of the text if the whole input is there
+    size_t lines_end() const {
+        return m_lines_end;
+    }
+};
+
+// Splits the input into the lines and the cells. The positions of all
+// the '\t' and '\n' are found block by block by the vector scan (see
+// scan_delimiters()) and each line is cut by them into the cells the
+// way getline() does: there are no cells in the empty line and no empty
+// cell after the trailing '\t'. The scanner may take a part of the input
+// which starts and ends at the line ends (see TableLoader).
+class TableScanner {
+    static const size_t BLOCK = 1 << 16;
+
+    const InputText &m_input;
+    size_t m_end;                   // offset of the end of the part
+    size_t m_block;                 // offset of the scanned block
+    size_t m_scanned;               // offset of the end of the block
+    vector<uint32_t> m_index;       // delimiters of the block (offsets)
+    size_t m_found;                 // number of them
+    size_t m_next;                  // next one to take
+    size_t m_pos;                   // offset of the next line
+    vector<size_t> m_bounds;        // offsets of the starts of the cells
+                                    // of the line, then the one after the
+                                    // end of the last cell
+
+    // scans the next block, returns false at the end of the input
+    bool scan_block();
+
+public:
+    // ctor, the part [begin, end) of the input is split
+    TableScanner(const InputText &input, const size_t begin,
+        const size_t end) : m_input(input), m_end(end), m_block(begin),
+        m_scanned(begin), m_index(BLOCK), m_found(0), m_next(0),
+        m_pos(begin) { }
+    // ctor, the whole input is split
+    explicit TableScanner(const InputText &input) :
+        TableScanner(input, 0, input.size()) { }
+
+    // gets the next line (without '\n') and cuts it into the cells,
+    // returns false if there are no more lines; the last line may have
+    // no '\n' as with getline()
+    bool get_line(TextView &line);
+
+    // offset of the next line
+    size_t get_pos() const {
+        return m_pos;
+    }
+
+    // number of the cells of the line
+    size_t get_cells() const {
+        return m_bounds.size() - 1;
+    }
+
+    // the cell of the line
+    TextView get_cell(const size_t c) const {
+        return TextView(m_input.data() + m_bounds[c],
+            m_bounds[c + 1] - 1 - m_bounds[c]);
+    }
+};
+
+// checks that the cell represents a string literal
+inline bool is_string_literal(const TextView &s) {
+    return s.front() == '\'';
+}
+
+// checks that the cell represents an expression
+inline bool is_expression(const TextView &s) {
+    return s.front() == '=';
+}
+
+// checks that the cell represents a positive number
+inline bool is_number(const TextView &s) {
+    if (s.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < s.size; i++) {
+        if (!isdigit(s.data[i])) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,288 @@
+#include <cstring>
+#include <cstdint>
+
+#include "jit.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X64
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Machine code of one function being generated. The code keeps the
+// address of the cell in r8 and the address of the result in r9, the
+// operands of the stack machine in xmm0 and xmm1; only the registers
+// which may be changed by the called function on both Windows and
+// System V conventions are used.
+class Emitter {
+    vector<unsigned char> &m_code;
+    vector<size_t> m_unexp;     // jumps to the exit with E_UNEXP_EXPR
+    vector<size_t> m_inf;       // jumps to the exit with E_INFINITE
+
+    void emit(const unsigned b) {
+        m_code.push_back(static_cast<unsigned char>(b));
+    }
+    void emit32(const int v) {
+        uint32_t u = static_cast<uint32_t>(v);
+        for (int i = 0; i < 4; i++) { emit((u >> (i * 8)) & 0xFF); }
+    }
+    void emit64(const uint64_t v) {
+        for (int i = 0; i < 8; i++) { emit((v >> (i * 8)) & 0xFF); }
+    }
+    // emits jump with rel32 to be patched, its position is added to jumps
+    void emit_jump(const unsigned op, vector<size_t> &jumps) {
+        emit(0x0F); emit(op);
+        jumps.push_back(m_code.size());
+        emit32(0);
+    }
+    // makes the jumps go to the current position
+    void patch(const vector<size_t> &jumps) {
+        for (size_t at : jumps) {
+            int rel = static_cast<int>(m_code.size() - (at + 4));
+            memcpy(&m_code[at], &rel, 4);
+        }
+    }
+    // mov eax, code; ret
+    void emit_return(const int code) {
+        emit(0xB8); emit32(code);
+        emit(0xC3);
+    }
+
+public:
+    Emitter(vector<unsigned char> &code) : m_code(code) { }
+
+    // moves the arguments to r8 and r9
+    void prologue() {
+#ifdef _WIN32
+        emit(0x49); emit(0x89); emit(0xC8);     // mov r8, rcx
+        emit(0x49); emit(0x89); emit(0xD1);     // mov r9, rdx
+#else
+        emit(0x49); emit(0x89); emit(0xF8);     // mov r8, rdi
+        emit(0x49); emit(0x89); emit(0xF1);     // mov r9, rsi
+#endif
+    }
+
+    // loads the number into the operand slot
+    void number(const int slot, const int value) {
+        emit(0xB8); emit32(value);                          // mov eax, imm
+        emit(0xF2); emit(0x0F); emit(0x2A);                 // cvtsi2sd
+        emit(0xC0 | (slot << 3));                           // xmm, eax
+    }
+
+    // loads the value of the cell at the offset from the cell of the
+    // expression into the operand slot, NaN if it's not a number
+    void reference(const int slot, const int type_disp, const int type,
+        const int number_disp) {
+        emit(0x41); emit(0x83); emit(0xB8);                 // cmp dword
+        emit32(type_disp); emit(type);                      // [r8+d], imm8
+        emit(0x75); emit(0x0B);                             // jne nan
+        emit(0xF2); emit(0x41); emit(0x0F); emit(0x10);     // movsd xmm,
+        emit(0x80 | (slot << 3)); emit32(number_disp);      // [r8+d]
+        emit(0xEB); emit(0x04);                             // jmp done
+        emit(0x66); emit(0x0F); emit(0x76);                 // nan: pcmpeqd
+        emit(0xC0 | (slot << 3) | slot);                    // xmm, xmm
+    }                                                       // done:
+
+    // applies the operator to the operands, the result goes to xmm0
+    void operation(const oper op) {
+        emit(0x66); emit(0x0F); emit(0x2E); emit(0xC1);     // ucomisd
+        emit_jump(0x8A, m_unexp);                           // jp unexp
+        emit(0xF2); emit(0x0F);
+        switch (op) {
+        case OP_ADD: emit(0x58); break;                     // addsd
+        case OP_SUB: emit(0x5C); break;                     // subsd
+        case OP_MUL: emit(0x59); break;                     // mulsd
+        default: emit(0x5E); break;                         // divsd
+        }
+        emit(0xC1);                                         // xmm0, xmm1
+        if (op == OP_DIV) { // infinity has all exponent bits set
+            emit(0x66); emit(0x48); emit(0x0F); emit(0x7E);
+            emit(0xC0);                                     // movq rax, xmm0
+            emit(0x48); emit(0xD1); emit(0xE0);             // shl rax, 1
+            emit(0x48); emit(0xB9);                         // mov rcx,
+            emit64(0xFFE0000000000000ull);                  // inf << 1
+            emit(0x48); emit(0x39); emit(0xC8);             // cmp rax, rcx
+            emit_jump(0x84, m_inf);                         // je inf
+        }
+        // truncation as static_cast<int>, out of range gives INT_MIN
+        emit(0xF2); emit(0x0F); emit(0x2C); emit(0xC0);     // cvttsd2si
+        emit(0xF2); emit(0x0F); emit(0x2A); emit(0xC0);     // cvtsi2sd
+    }
+
+    // stops with the error
+    void error(const err_code code) {
+        emit_return(code);
+    }
+
+    // stores the result and returns E_NONE, adds the exits with errors
+    void epilogue() {
+        emit(0xF2); emit(0x41); emit(0x0F); emit(0x11);
+        emit(0x01);                                         // movsd [r9], xmm0
+        emit_return(E_NONE);
+        patch(m_unexp);
+        emit_return(E_UNEXP_EXPR);
+        patch(m_inf);
+        emit_return(E_INFINITE);
+    }
+};
+
+// releases the memory of the functions
+void NativeCode::release() {
+    if (m_memory == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    VirtualFree(m_memory, 0, MEM_RELEASE);
+#else
+    munmap(m_memory, m_size);
+#endif
+    m_memory = nullptr;
+    m_size = 0;
+}
+
+// checks that the native code can be generated on this processor
+bool NativeCode::is_supported() {
+#ifdef JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+// checks that the program can be compiled
+bool NativeCode::can_compile(const Program &prog) {
+    int sp = 0;
+    int ops = 0;
+    for (const Instr &in : prog.m_code) {
+        switch (in.code) {
+        case Instr::I_NUM:
+        case Instr::I_REF:
+            if (sp == Program::MAX_STACK) {
+                return false;
+            }
+            sp++;
+            break;
+        case Instr::I_TOUCH:
+            break;
+        case Instr::I_OPER:
+            if (sp != 2 || in.arg < OP_ADD || in.arg > OP_DIV) {
+                return false;
+            }
+            sp = 1;
+            ops++;
+            break;
+        case Instr::I_ERROR:
+            return ops > 0;
+        default:
+            return false;
+        }
+    }
+    return ops > 0 && sp == 1;
+}
+
+// compiles the programs into one block of executable memory
+vector<NativeCode::function_t> NativeCode::compile(
+    const vector<const Program*> &programs, const Layout &layout) {
+    vector<function_t> functions(programs.size(), nullptr);
+    release();
+    if (!is_supported() || layout.type_size != 4 ||
+        layout.number_type < 0 || layout.number_type > 127) {
+        return functions;
+    }
+
+    const long long limit = 0x7FFFFFFF;
+    vector<unsigned char> code;
+    vector<size_t> starts(programs.size(), 0);
+    vector<bool> compiled(programs.size(), false);
+    for (size_t p = 0; p < programs.size(); p++) {
+        if (programs[p] == nullptr || !can_compile(*programs[p])) {
+            continue;
+        }
+        // the displacements of the references have to fit 32 bits
+        bool fits = true;
+        for (const Instr &in : programs[p]->m_code) {
+            long long disp = static_cast<long long>(in.arg) *
+                static_cast<long long>(layout.stride);
+            if (in.code == Instr::I_REF && (disp > limit - 64 ||
+                disp < -limit + 64)) {
+                fits = false;
+            }
+        }
+        if (!fits) {
+            continue;
+        }
+
+        starts[p] = code.size();
+        compiled[p] = true;
+        Emitter emitter(code);
+        emitter.prologue();
+        int sp = 0;
+        for (const Instr &in : programs[p]->m_code) {
+            int disp = in.arg * static_cast<int>(layout.stride);
+            if (in.code == Instr::I_NUM) {
+                emitter.number(sp++, in.arg);
+            }
+            else if (in.code == Instr::I_REF) {
+                emitter.reference(sp++,
+                    disp + static_cast<int>(layout.type_offset),
+                    layout.number_type,
+                    disp + static_cast<int>(layout.number_offset));
+            }
+            else if (in.code == Instr::I_OPER) {
+                emitter.operation(static_cast<oper>(in.arg));
+                sp = 1;
+            }
+            else if (in.code == Instr::I_ERROR) {
+                emitter.error(static_cast<err_code>(in.arg));
+                break;
+            }
+        }
+        emitter.epilogue();
+    }
+    if (code.empty()) {
+        return functions;
+    }
+
+    // the code is copied to writable memory which is then made executable
+#ifdef _WIN32
+    void *memory = VirtualAlloc(nullptr, code.size(),
+        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (memory == nullptr) {
+        return functions;
+    }
+    memcpy(memory, code.data(), code.size());
+    DWORD old;
+    if (!VirtualProtect(memory, code.size(), PAGE_EXECUTE_READ, &old)) {
+        VirtualFree(memory, 0, MEM_RELEASE);
+        return functions;
+    }
+    FlushInstructionCache(GetCurrentProcess(), memory, code.size());
+#else
+    void *memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return functions;
+    }
+    memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, code.size());
+        return functions;
+    }
+#endif
+    m_memory = memory;
+    m_size = code.size();
+
+    for (size_t p = 0; p < programs.size(); p++) {
+        if (compiled[p]) {
+            functions[p] = reinterpret_cast<function_t>(
+                static_cast<unsigned char*>(memory) + starts[p]);
+        }
+    }
+    return functions;
+}
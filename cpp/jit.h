@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+
+#include "program.h"
+
+using namespace std;
+
+// Native x86-64 code of the programs (shapes) generated at run time into
+// executable memory, no external compiler is used. The function of the
+// program gets the address of the cell of the expression (the cells are
+// laid out as described by Layout) and returns E_NONE with the result
+// stored into out or the error code. The semantics are those of
+// Tokenizer::execute(): each operation is applied in double and its
+// result is truncated to int, the operand which is not a number gives
+// E_UNEXP_EXPR and division by zero E_INFINITE.
+// Only the programs of the form which doesn't need the tokens to be
+// copied are compiled (see can_compile()), the others are left to the
+// interpreter as well as the whole code on other processors.
+class NativeCode {
+    void *m_memory;                 // executable memory of the functions
+    size_t m_size;                  // size of the memory
+
+    // releases the memory of the functions
+    void release();
+
+public:
+    typedef int (*function_t)(const char *cell, double *out);
+
+    // layout of the cells in memory
+    struct Layout {
+        size_t stride;              // size of the cell
+        size_t type_offset;         // offset of the type of the value
+        size_t type_size;           // size of the type of the value
+        int number_type;            // value of the type of the number
+        size_t number_offset;       // offset of the number
+    };
+
+    NativeCode() : m_memory(nullptr), m_size(0) { }
+    ~NativeCode() { release(); }
+
+    NativeCode(const NativeCode&) = delete;
+    NativeCode& operator=(const NativeCode&) = delete;
+
+    // checks that the native code can be generated on this processor
+    static bool is_supported();
+
+    // checks that the program can be compiled: it consists of numbers,
+    // references and operators (at least one of them), may stop with an
+    // error and results in the only operand
+    static bool can_compile(const Program &prog);
+
+    // compiles the programs, the ones which are nullptr or can't be
+    // compiled get nullptr function; the functions of the previous call
+    // are released
+    vector<function_t> compile(const vector<const Program*> &programs,
+        const Layout &layout);
+
+    // size of the generated code
+    size_t size() const {
+        return m_size;
+    }
+};
@@ -0,0 +1,288 @@
+#include <cmath>
+
+#include "kernels.h"
+#include "checked.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// SSE2 is there on every x86-64 processor, the 32-bit code may be built
+// without it
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KERNELS_SSE2
+#endif
+#endif
+
+// the functions using AVX2 are compiled for it whatever the target of
+// the rest of the program is, they are called only if the processor
+// supports it
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// value of the operand in the lane j
+static inline double get_lane(const KernelOperand &operand, const size_t j) {
+    return operand.column ? operand.column[j] : operand.number;
+}
+
+// evaluates the lanes [begin, end) one by one
+static void eval_lanes(const vector<oper> &ops,
+    const vector<KernelOperand> &operands, const size_t begin,
+    const size_t end, double *out, unsigned char *errors) {
+    for (size_t j = begin; j < end; j++) {
+        double acc = get_lane(operands[0], j);
+        err_code err = E_NONE;
+
+        for (size_t i = 0; i < ops.size(); i++) {
+            double x = get_lane(operands[i + 1], j);
+            if (std::isnan(acc) || std::isnan(x)) {
+                err = E_UNEXP_EXPR;
+                break;
+            }
+            switch (ops[i]) {
+            case OP_ADD: acc += x;
+                break;
+            case OP_SUB: acc -= x;
+                break;
+            case OP_MUL: acc *= x;
+                break;
+            default: acc /= x;
+                break;
+            }
+            if (ops[i] == OP_DIV && std::isinf(acc)) {
+                err = E_INFINITE;
+                break;
+            }
+            acc = static_cast<int>(acc);
+        }
+
+        out[j] = acc;
+        errors[j] = static_cast<unsigned char>(err);
+    }
+}
+
+#ifdef KERNELS_X86
+// checks that the processor and the system support AVX2
+static bool has_avx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const int osxsave = 1 << 27, avx = 1 << 28;
+    if ((info[2] & (osxsave | avx)) != (osxsave | avx) ||
+        (_xgetbv(0) & 6) != 6) { // xmm and ymm state enabled
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+// values of the operand in the lanes [j, j + 4)
+TARGET_AVX2 static inline __m256d load_lanes(const KernelOperand &operand,
+    const size_t j) {
+    return operand.column ? _mm256_loadu_pd(operand.column + j) :
+        _mm256_set1_pd(operand.number);
+}
+
+// evaluates the lanes four at a time, the errors are tracked as masks
+// of the lanes, a lane with an error keeps it; returns the number of the
+// lanes evaluated
+TARGET_AVX2 static size_t eval_lanes_avx2(const vector<oper> &ops,
+    const vector<KernelOperand> &operands, const size_t count,
+    double *out, unsigned char *errors) {
+    const __m256d inf = _mm256_set1_pd(HUGE_VAL);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    size_t j = 0;
+
+    for (; j + 4 <= count; j += 4) {
+        __m256d acc = load_lanes(operands[0], j);
+        __m256d unexp = _mm256_setzero_pd();
+        __m256d infinite = _mm256_setzero_pd();
+
+        for (size_t i = 0; i < ops.size(); i++) {
+            __m256d x = load_lanes(operands[i + 1], j);
+            __m256d done = _mm256_or_pd(unexp, infinite);
+            __m256d bad = _mm256_cmp_pd(acc, x, _CMP_UNORD_Q); // NaN
+            unexp = _mm256_or_pd(unexp, _mm256_andnot_pd(done, bad));
+
+            switch (ops[i]) {
+            case OP_ADD: acc = _mm256_add_pd(acc, x);
+                break;
+            case OP_SUB: acc = _mm256_sub_pd(acc, x);
+                break;
+            case OP_MUL: acc = _mm256_mul_pd(acc, x);
+                break;
+            default: acc = _mm256_div_pd(acc, x);
+                done = _mm256_or_pd(unexp, infinite);
+                bad = _mm256_cmp_pd(_mm256_andnot_pd(sign, acc), inf,
+                    _CMP_EQ_OQ);
+                infinite = _mm256_or_pd(infinite,
+                    _mm256_andnot_pd(done, bad));
+                break;
+            }
+            // truncation as static_cast<int>, out of range gives INT_MIN
+            acc = _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(acc));
+        }
+
+        _mm256_storeu_pd(out + j, acc);
+        int u = _mm256_movemask_pd(unexp);
+        int f = _mm256_movemask_pd(infinite);
+        for (int k = 0; k < 4; k++) {
+            errors[j + k] = static_cast<unsigned char>(((u >> k) & 1) ?
+                E_UNEXP_EXPR : (((f >> k) & 1) ? E_INFINITE : E_NONE));
+        }
+    }
+
+    return j;
+}
+#endif
+
+// evaluates the expression for all the lanes
+void eval_column(const vector<oper> &ops,
+    const vector<KernelOperand> &operands, const size_t count,
+    double *out, unsigned char *errors) {
+    size_t done = 0;
+#ifdef KERNELS_X86
+    static const bool avx2 = has_avx2();
+    if (avx2) {
+        done = eval_lanes_avx2(ops, operands, count, out, errors);
+    }
+#endif
+    eval_lanes(ops, operands, done, count, out, errors);
+}
+
+// evaluates the expression for all the lanes one by one, the operations
+// are checked for overflow
+void eval_column_int(const vector<oper> &ops,
+    const vector<IntKernelOperand> &operands, const size_t count,
+    long long *out, unsigned char *errors) {
+    auto is_number = [](const IntKernelOperand &operand, const size_t j) {
+        return operand.column == nullptr || operand.valid[j] != 0;
+    };
+    auto get_lane = [](const IntKernelOperand &operand, const size_t j) {
+        return operand.column ? operand.column[j] : operand.number;
+    };
+
+    for (size_t j = 0; j < count; j++) {
+        long long acc = get_lane(operands[0], j);
+        err_code err = is_number(operands[0], j) ? E_NONE : E_UNEXP_EXPR;
+
+        for (size_t i = 0; i < ops.size() && err == E_NONE; i++) {
+            if (!is_number(operands[i + 1], j)) {
+                err = E_UNEXP_EXPR;
+                break;
+            }
+            err = apply_checked(ops[i], acc, get_lane(operands[i + 1], j),
+                acc);
+        }
+
+        out[j] = acc;
+        errors[j] = static_cast<unsigned char>(err);
+    }
+}
+
+// writes the offsets of the delimiters in [begin, end) one by one
+static size_t scan_bytes(const char *text, const size_t begin,
+    const size_t end, uint32_t *positions) {
+    size_t n = 0;
+    for (size_t i = begin; i < end; i++) {
+        if (text[i] == '\t' || text[i] == '\n') {
+            positions[n++] = static_cast<uint32_t>(i);
+        }
+    }
+    return n;
+}
+
+#ifdef KERNELS_X86
+// number of the trailing zero bits of the nonzero mask
+static inline unsigned count_trailing_zeros(const unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return bit;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// writes the offsets of the bits of the mask of the bytes starting at base
+static inline size_t put_mask(unsigned mask, const size_t base,
+    uint32_t *positions) {
+    size_t n = 0;
+    while (mask != 0) {
+        positions[n++] = static_cast<uint32_t>(base +
+            count_trailing_zeros(mask));
+        mask &= mask - 1;
+    }
+    return n;
+}
+
+// scans the text 32 bytes at a time, returns the number of the bytes
+// scanned and the delimiters found in them
+TARGET_AVX2 static size_t scan_avx2(const char *text, const size_t size,
+    uint32_t *positions, size_t &found) {
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(text + i));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, tab),
+            _mm256_cmpeq_epi8(bytes, newline));
+        found += put_mask(static_cast<unsigned>(_mm256_movemask_epi8(hits)),
+            i, positions + found);
+    }
+    return i;
+}
+
+#ifdef KERNELS_SSE2
+// the same 16 bytes at a time
+static size_t scan_sse2(const char *text, const size_t size,
+    uint32_t *positions, size_t &found) {
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(bytes, tab),
+            _mm_cmpeq_epi8(bytes, newline));
+        found += put_mask(static_cast<unsigned>(_mm_movemask_epi8(hits)),
+            i, positions + found);
+    }
+    return i;
+}
+#endif
+#endif
+
+// finds the delimiters by the widest scan the processor supports, the
+// tail shorter than it is scanned one byte at a time
+size_t scan_delimiters(const char *text, const size_t size,
+    uint32_t *positions) {
+    size_t done = 0, found = 0;
+#ifdef KERNELS_X86
+    static const bool avx2 = has_avx2();
+    if (avx2) {
+        done = scan_avx2(text, size, positions, found);
+    }
+#ifdef KERNELS_SSE2
+    else {
+        done = scan_sse2(text, size, positions, found);
+    }
+#endif
+#endif
+    return found + scan_bytes(text, done, size, positions + found);
+}
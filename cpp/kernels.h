@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "program.h"
+
+using namespace std;
+
+// One operand of the column kernel: either the column of values (one per
+// lane) or the number which is the same for all lanes. The lanes where
+// the operand is not a number hold NaN.
+struct KernelOperand {
+    const double *column;   // values of the lanes, nullptr for the number
+    double number;          // value of the number
+
+    KernelOperand(const double *col) : column(col), number(0) { }
+    KernelOperand(const double num) : column(nullptr), number(num) { }
+};
+
+// Evaluates the expression of the form x0 op1 x1 op2 x2 ... for count
+// lanes at once: operands[0] is x0, ops[i] is applied to the result so
+// far and operands[i + 1]. The result of each operation is truncated
+// to int as Tokenizer::evaluate() does.
+// out gets the results, errors gets the error of each lane (E_NONE,
+// E_UNEXP_EXPR if the operand is not a number or E_INFINITE for
+// division by zero), the first error of the lane stops it.
+// AVX2 is used if the processor supports it.
+void eval_column(const vector<oper> &ops,
+    const vector<KernelOperand> &operands, const size_t count,
+    double *out, unsigned char *errors);
+
+// One operand of the integer column kernel: either the column of values
+// with the flags of the lanes which are numbers or the number which is
+// the same for all lanes
+struct IntKernelOperand {
+    const long long *column;    // values of the lanes, nullptr for the number
+    const unsigned char *valid; // nonzero for the lanes holding numbers
+    long long number;           // value of the number
+
+    IntKernelOperand(const long long *col, const unsigned char *val) :
+        column(col), valid(val), number(0) { }
+    IntKernelOperand(const long long num) : column(nullptr), valid(nullptr),
+        number(num) { }
+};
+
+// Evaluates the expression of the form x0 op1 x1 op2 x2 ... for count
+// lanes in 64-bit integers as Tokenizer::evaluate() does in the integer
+// mode (see apply_checked()). errors gets E_OVERFLOW for the lane whose
+// result doesn't fit, the other errors are those of eval_column().
+void eval_column_int(const vector<oper> &ops,
+    const vector<IntKernelOperand> &operands, const size_t count,
+    long long *out, unsigned char *errors);
+
+// Finds the '\t' and '\n' of the text (at most 4 GiB) and writes their
+// offsets in order to positions, which has room for size of them;
+// returns their number. 32 bytes (AVX2) or 16 bytes (SSE2) of the text
+// are compared at once.
+size_t scan_delimiters(const char *text, const size_t size,
+    uint32_t *positions);
@@ -0,0 +1,138 @@
+#include <thread>
+#include <functional>
+#include <cstring>
+
+#include "loader.h"
+
+// fills out the rows of the chunk the way the lines used to be read one
+// by one: the chunk starting beyond the rows has nothing to fill out,
+// the one reaching the first line beyond them stops there
+void TableLoader::load_chunk(Chunk &chunk) const {
+    if (chunk.row > m_rows) {
+        return;
+    }
+    ostringstream warnings;
+    TableScanner scanner(m_input, chunk.begin, chunk.end);
+    TextView line;
+    Program program;
+    short i = static_cast<short>(chunk.row);
+    while (scanner.get_line(line))
+    {
+        if (i == m_rows) {
+            if (m_verbose) {
+                warnings << "Warning: More lines than expected."
+                    "Skipping the remaining lines" << endl;
+            }
+            break;
+        }
+
+        if (m_verbose) {
+            int cols_count = count_if(line.data, line.data + line.size,
+                ::isspace) + 1;
+            if (cols_count > m_cols) {
+                warnings << "Warning: Extra columns detected in line #"
+                    << i + 1 << " Skipping..." << endl;
+            }
+        }
+
+        // the extra cells are skipped, the missing ones are left empty
+        short count = static_cast<short>(min(scanner.get_cells(),
+            static_cast<size_t>(m_cols)));
+        for (short j = 0; j < count; j++)
+        {
+            TextView data = scanner.get_cell(j);
+
+            if (is_expression(data) && m_keep_text) {
+                // compiled only if there is no compiled sheet
+                m_cells[i][j].assign(data.data, data.size);
+            }
+            else if (is_expression(data)) {
+                // only the shape is kept, the text is not needed any more
+                m_compiler.compile(data.data, data.size, i * m_cols + j,
+                    program);
+                if (m_optimize) {
+                    chunk.optimizer.optimize(program);
+                }
+                chunk.expressions.push_back(Expr(make_pair(i, j),
+                    chunk.shapes.intern(program)));
+                m_cells[i][j] = "=";
+            }
+            else if (data.empty() || is_number(data) ||
+                is_string_literal(data)) {
+                m_cells[i][j].assign(data.data, data.size);
+            }
+            else { // marking unsupported cells by error msg
+                m_cells[i][j] = "#E_UNKNOWN";
+            }
+        }
+        i++;
+    }
+    chunk.warnings = warnings.str();
+}
+
+void TableLoader::load(const size_t pos, const unsigned threads,
+    vector<Expr> &expressions, ShapeTable &shapes, Optimizer &optimizer) {
+    const char *text = m_input.data();
+    const size_t size = m_input.size();
+    size_t body = (pos < size) ? size - pos : 0;
+    size_t n_chunks = max<size_t>(1,
+        min<size_t>(max(threads, 1u), body / MIN_CHUNK));
+
+    // the chunks end after the first line end past their equal shares
+    vector<Chunk> chunks(n_chunks);
+    size_t begin = min(pos, size);
+    for (size_t k = 0; k < n_chunks; k++) {
+        size_t end = size;
+        if (k + 1 < n_chunks) {
+            size_t share = min(max(begin, pos + body / n_chunks * (k + 1)),
+                size);
+            const char *nl = static_cast<const char*>(
+                memchr(text + share, '\n', size - share));
+            end = (nl == nullptr) ? size : (nl - text) + 1;
+        }
+        chunks[k].begin = begin;
+        chunks[k].end = end;
+        begin = end;
+    }
+
+    // runs fn(k) for each chunk on its own thread
+    auto for_chunks = [&](const function<void(size_t)> &fn) {
+        vector<thread> helpers;
+        for (size_t k = 1; k < n_chunks; k++) {
+            helpers.push_back(thread(fn, k));
+        }
+        fn(0);
+        for (auto &t : helpers) { t.join(); }
+    };
+
+    // the line ends before the chunk give the row it starts at
+    vector<size_t> lines(n_chunks, 0);
+    if (n_chunks > 1) {
+        for_chunks([&](size_t k) {
+            lines[k] = count(text + chunks[k].begin, text + chunks[k].end,
+                '\n');
+        });
+    }
+    size_t row = 0;
+    for (size_t k = 0; k < n_chunks; k++) {
+        chunks[k].row = static_cast<int>(min(row, m_rows + size_t(1)));
+        row += lines[k];
+    }
+
+    for_chunks([&](size_t k) { load_chunk(chunks[k]); });
+
+    // the shapes of each chunk are added in the order of their ids, so
+    // the ids are given in the order of the first use as by one thread
+    vector<int> ids;
+    for (auto &chunk : chunks) {
+        ids.resize(chunk.shapes.size());
+        for (size_t s = 0; s < ids.size(); s++) {
+            ids[s] = shapes.intern(chunk.shapes.get(static_cast<int>(s)));
+        }
+        for (auto &ex : chunk.expressions) {
+            expressions.push_back(Expr(ex.m_coords, ids[ex.m_shape]));
+        }
+        optimizer.merge(chunk.optimizer);
+        cerr << chunk.warnings;
+    }
+}
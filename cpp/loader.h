@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "eltab.h"
+#include "input.h"
+
+// Fills out the table (cells) with the raw values of the lines of the
+// input following the header, compiling the expressions. The lines are
+// independent, so the body is cut at the line ends into the chunks, one
+// per thread; the line ends are counted first to get the row each chunk
+// starts at, then each thread fills out the rows of its chunk with its
+// own optimizer and shape table. The expressions and the shapes of the
+// chunks are merged in the order of the rows, so the table, the
+// expressions and the ids of the shapes are the same as of one thread.
+// The cells beyond the columns of the header and the lines beyond its
+// rows are skipped, the missing ones are left empty.
+class TableLoader {
+    // minimal size of the body per thread, a smaller one isn't worth it
+    static const size_t MIN_CHUNK = 1 << 20;
+
+    // part of the body loaded by one thread
+    struct Chunk {
+        size_t begin;               // offset of its first line
+        size_t end;                 // offset after its last line
+        int row;                    // row of its first line
+        vector<Expr> expressions;   // with the ids of the shapes below
+        ShapeTable shapes;
+        Optimizer optimizer;
+        string warnings;            // verbose messages of its lines
+    };
+
+    const InputText &m_input;
+    short m_rows;                   // number of rows(lines) in table
+    short m_cols;                   // number of columns in table
+    string **m_cells;
+    bool m_keep_text;               // the expressions are kept as text
+    bool m_optimize;                // the programs are optimized
+    bool m_verbose;                 // inconsistencies are reported
+    Compiler m_compiler;
+
+    // fills out the rows of the chunk
+    void load_chunk(Chunk &chunk) const;
+
+public:
+    // ctor, the expressions are kept as text (to be compiled into the
+    // sheet, see aot.h) if keep_text is set
+    TableLoader(const InputText &input, const short rows, const short cols,
+        string **cells, const bool keep_text, const bool optimize,
+        const bool verbose) : m_input(input), m_rows(rows), m_cols(cols),
+        m_cells(cells), m_keep_text(keep_text), m_optimize(optimize),
+        m_verbose(verbose), m_compiler(rows, cols) { }
+
+    // loads the lines starting at the offset pos on at most the given
+    // number of threads; the expressions are added with the shapes of
+    // the given table, the optimizer counts the instructions removed
+    void load(const size_t pos, const unsigned threads,
+        vector<Expr> &expressions, ShapeTable &shapes,
+        Optimizer &optimizer);
+};
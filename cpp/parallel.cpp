@@ -0,0 +1,151 @@
+#include <memory>
+
+#include "eltab.h"
+#include "thread_pool.h"
+#include "work_queue.h"
+
+// Evaluates expressions level by level: level of the expression is one
+// more than the highest level of the expressions it references, so all
+// the expressions of one level only read the values of lower levels and
+// are evaluated in parallel. The expression sharing the prefix evaluated
+// by another one (see share_prefixes()) is put above that one too.
+// The levels follow the order worked out by sort(), so the results are
+// the same as of serial evaluation.
+void Tokenizer::run_levels(const unsigned threads) {
+    vector<int> levels(m_cells.size(), 0);
+    int top = 0;
+
+    // the cells which are put in order later (e.g. the cross-referenced
+    // one) are never read and still have level 0 here
+    for (int idx : m_order) {
+        int level = 0;
+        for (const int *dep = m_graph.deps_begin(idx);
+            dep < m_graph.deps_end(idx); ++dep) {
+            level = max(level, levels[*dep]);
+        }
+        int owner = get_prefix_owner(idx);
+        if (owner >= 0) {
+            level = max(level, levels[owner]);
+        }
+        levels[idx] = level + 1;
+        top = max(top, level + 1);
+    }
+
+    // expressions grouped by level in compressed form
+    vector<size_t> offsets(top + 2, 0);
+    for (int idx : m_order) { offsets[levels[idx] + 1]++; }
+    for (int l = 1; l <= top + 1; l++) { offsets[l] += offsets[l - 1]; }
+    vector<int> cells(m_order.size());
+    vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (int idx : m_order) { cells[fill[levels[idx]]++] = idx; }
+
+    ThreadPool pool(threads);
+    for (int l = 1; l <= top; l++) {
+        const int *level = cells.data() + offsets[l];
+        pool.parallel_for(offsets[l + 1] - offsets[l], [&](size_t i) {
+            eval_cell(level[i]);
+        });
+    }
+}
+
+// Evaluates expressions as a dataflow: each expression waits for the
+// number of the expressions it reads, the last of them to be evaluated
+// makes it ready. Ready expressions are queued by the worker which made
+// them ready, the idle workers steal from the queues of the others.
+// Only the cells put in order before the expression are waited for,
+// the ones put later are never read (e.g. the cross-referenced one).
+// The expression sharing the prefix evaluated by another one waits for
+// that one as well.
+void Tokenizer::run_stealing(const unsigned threads) {
+    const unsigned n_workers = max(threads, 1u);
+
+    vector<int> position(m_cells.size(), -1);
+    for (size_t i = 0; i < m_order.size(); i++) {
+        position[m_order[i]] = static_cast<int>(i);
+    }
+    auto is_input = [&](const int idx, const int dep) {
+        return position[dep] >= 0 && position[dep] < position[idx];
+    };
+
+    // the expressions waiting for each cell in compressed form
+    vector<size_t> offsets(m_cells.size() + 1, 0);
+    unique_ptr<atomic<int>[]> pending(new atomic<int>[m_cells.size()]);
+    for (int idx : m_order) {
+        int inputs = 0;
+        for (const int *dep = m_graph.deps_begin(idx);
+            dep < m_graph.deps_end(idx); ++dep) {
+            if (is_input(idx, *dep)) {
+                offsets[*dep + 1]++;
+                inputs++;
+            }
+        }
+        int owner = get_prefix_owner(idx);
+        if (owner >= 0) {
+            offsets[owner + 1]++;
+            inputs++;
+        }
+        pending[idx].store(inputs, memory_order_relaxed);
+    }
+    for (size_t c = 1; c < offsets.size(); c++) {
+        offsets[c] += offsets[c - 1];
+    }
+    vector<int> waiting(offsets.back());
+    vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (int idx : m_order) {
+        for (const int *dep = m_graph.deps_begin(idx);
+            dep < m_graph.deps_end(idx); ++dep) {
+            if (is_input(idx, *dep)) {
+                waiting[fill[*dep]++] = idx;
+            }
+        }
+        int owner = get_prefix_owner(idx);
+        if (owner >= 0) {
+            waiting[fill[owner]++] = idx;
+        }
+    }
+
+    vector<WorkQueue> queues(n_workers);
+    m_worker_stats.assign(n_workers, WorkerStats());
+    atomic<size_t> remaining(m_order.size());
+
+    // the expressions ready from the start are dealt out to all workers
+    unsigned next = 0;
+    for (int idx : m_order) {
+        if (pending[idx].load(memory_order_relaxed) == 0) {
+            queues[next++ % n_workers].push(idx);
+        }
+    }
+
+    auto worker = [&](const unsigned self) {
+        WorkerStats &stats = m_worker_stats[self];
+        int idx;
+        while (remaining.load(memory_order_acquire) > 0) {
+            bool found = queues[self].pop(idx);
+            for (unsigned i = 1; !found && i < n_workers; i++) {
+                found = queues[(self + i) % n_workers].steal(idx);
+                stats.steals += found;
+            }
+            if (!found) {
+                this_thread::yield();
+                continue;
+            }
+
+            eval_cell(idx);
+            stats.executed++;
+            for (size_t w = offsets[idx]; w < offsets[idx + 1]; w++) {
+                if (pending[waiting[w]].fetch_sub(1,
+                    memory_order_acq_rel) == 1) {
+                    queues[self].push(waiting[w]);
+                }
+            }
+            remaining.fetch_sub(1, memory_order_release);
+        }
+    };
+
+    vector<thread> helpers;
+    for (unsigned w = 1; w < n_workers; w++) {
+        helpers.push_back(thread(worker, w));
+    }
+    worker(0);
+    for (auto &t : helpers) { t.join(); }
+}
@@ -0,0 +1,188 @@
+#include "eltab.h"
+
+// returns the error code as it is printed out
+const char* get_error_str(const err_code code) {
+    switch (code) {
+    case E_UNEXP_SYMBOL: return "#E_UNEXP_SYMBOL";
+    case E_UNEXP_SYMB: return "#E_UNEXP_SYMB";
+    case E_INVALID_REF: return "#E_INVALID_REF";
+    case E_CROSS_REF: return "#E_CROSS_REF";
+    case E_UNEXP_EXPR: return "#E_UNEXP_EXPR";
+    case E_INFINITE: return "#E_INFINITE";
+    case E_UNKNOWN_OP: return "#E_UNKNOWN_OP";
+    case E_WRONG_REF: return "E_WRONG_REF";
+    case E_OVERFLOW: return "#E_OVERFLOW";
+    case E_TIMEOUT: return "#E_TIMEOUT";
+    default: return "";
+    }
+}
+
+// returns position of the k-th reference (I_REF or I_TOUCH)
+int Program::get_ref_pc(size_t k) const {
+    for (size_t pc = 0; pc < m_code.size(); pc++) {
+        if (m_code[pc].code == Instr::I_REF ||
+            m_code[pc].code == Instr::I_TOUCH) {
+            if (k-- == 0) {
+                return static_cast<int>(pc);
+            }
+        }
+    }
+    return -1;
+}
+
+// hash of the instructions
+size_t Program::hash() const {
+    size_t h = m_code.size();
+    for (const Instr &in : m_code) {
+        h = h * 31 + in.code;
+        h = h * 31 + static_cast<unsigned>(in.arg);
+    }
+    return h;
+}
+
+// returns id of the shape, adds it if it is new
+int ShapeTable::intern(const Program &prog) {
+    auto it = m_ids.find(prog);
+    if (it == m_ids.end()) {
+        it = m_ids.emplace(prog, static_cast<int>(m_shapes.size())).first;
+        m_shapes.push_back(&it->first);
+    }
+    return it->second;
+}
+
+// Compiles expression using reduced reverse polish notation algorithm.
+// No parenthesis, all operations' priorities are equal.
+// The scanning rules are the same the evaluation used to have: two
+// operands are combined as soon as an operator is pending between them.
+// The depth of the operand stack is known at each point, so operators
+// are emitted right after their second operand and operands which can
+// never contribute to the result (e.g. "=1A1A2") only resolve their
+// reference. Malformed expressions get I_ERROR at the point where the
+// error was found, so errors of the preceding part still come first.
+// An expression which doesn't reduce to one operand results in the
+// value of the last reference (see Program).
+void Compiler::compile(const char *str, const size_t size,
+    const int anchor, Program &prog) const {
+    prog.m_code.clear();
+    int depth = 0; // number of operands on the stack
+    bool has_ref = false; // there is a reference
+    int last_ref = 0; // relative cell index of the last reference
+    oper op(OP_NONE); // current operator
+
+    // emits operand and the pending operator once both operands are there
+    auto push_operand = [&](const Instr &operand) {
+        ++depth;
+        if (depth <= Program::MAX_STACK) {
+            prog.m_code.push_back(operand);
+        }
+        else if (operand.code == Instr::I_REF) {
+            prog.m_code.push_back(Instr(Instr::I_TOUCH, operand.arg));
+        }
+        if (depth == 2 && op != OP_NONE) {
+            prog.m_code.push_back(Instr(Instr::I_OPER, op));
+            depth = 1;
+            op = OP_NONE;
+        }
+    };
+    auto fail = [&](const err_code code) {
+        prog.m_code.push_back(Instr(Instr::I_ERROR, code));
+    };
+
+    // skipping leading '='
+    const char *end = str + size;
+    for (const char *it = str + 1; it < end; ++it) {
+        if (is_operator(*it)) { // processing operators
+            if (op != OP_NONE || depth == 0) {
+                fail(E_UNEXP_SYMBOL);
+                return;
+            }
+            op = get_operator(*it);
+        }
+        else if (isdigit(*it)) { // processing numbers
+            push_operand(Instr(Instr::I_NUM, get_number_by_str(it, end)));
+        }
+        else if (is_ref_candidate(*it)) { // processing references
+            // e.g. "B7" => col=1
+            short col = get_col_by_char(*it);
+            ++it;
+            // e.g. "A3" => row=2
+            short row = (it == end) ? -1 :
+                get_number_by_str(it, end) - 1;
+
+            // reference index is out of bound
+            if (row + 1 > m_rows || row < 0) {
+                fail(E_INVALID_REF);
+                return;
+            }
+
+            last_ref = row * m_cols + col - anchor;
+            has_ref = true;
+            push_operand(Instr(Instr::I_REF, last_ref));
+        }
+        else { // all other tokens are considered as unexpected (malformed)
+            fail(E_UNEXP_SYMB);
+            return;
+        }
+    }
+
+    if (depth != 1 && has_ref) {
+        prog.m_code.push_back(Instr(Instr::I_RESULT, last_ref));
+    }
+}
+
+// folds the constant prefix of the program: the stack is empty at its
+// start, so each pair of numbers followed by the operator is replaced
+// by the number of the result computed as Tokenizer::evaluate() does
+void Optimizer::fold_constants(Program &prog) {
+    vector<Instr> &code = prog.m_code;
+    size_t pc = 0;
+    double value = 0;
+    while (pc + 2 < code.size() && code[0].code == Instr::I_NUM &&
+        code[pc + 1].code == Instr::I_NUM &&
+        code[pc + 2].code == Instr::I_OPER) {
+        double res = (pc == 0) ? code[0].arg : value;
+        double right = code[pc + 1].arg;
+        switch (code[pc + 2].arg) {
+        case OP_ADD: res += right; break;
+        case OP_SUB: res -= right; break;
+        case OP_MUL: res *= right; break;
+        case OP_DIV: res /= right; break;
+        default: res = numeric_limits<double>::quiet_NaN(); break;
+        }
+        // errors and the results out of int range are left to evaluation
+        if (!(res > numeric_limits<int>::min() - 1.0 &&
+            res < numeric_limits<int>::max() + 1.0)) {
+            break;
+        }
+        value = static_cast<int>(res);
+        pc += 2;
+    }
+    if (pc > 0) {
+        code[0].arg = static_cast<int>(value);
+        code.erase(code.begin() + 1, code.begin() + pc + 1);
+        m_removed += pc;
+    }
+}
+
+// removes the operations with the identity which follow another
+// operation, the only operand on the stack is its numeric result then
+void Optimizer::remove_identities(Program &prog) {
+    vector<Instr> &code = prog.m_code;
+    size_t out = 0;
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        if (out > 0 && code[out - 1].code == Instr::I_OPER &&
+            pc + 1 < code.size() && code[pc].code == Instr::I_NUM &&
+            code[pc + 1].code == Instr::I_OPER) {
+            int num = code[pc].arg;
+            int op = code[pc + 1].arg;
+            if ((num == 0 && (op == OP_ADD || op == OP_SUB)) ||
+                (num == 1 && (op == OP_MUL || op == OP_DIV))) {
+                pc++;
+                m_removed += 2;
+                continue;
+            }
+        }
+        code[out++] = code[pc];
+    }
+    code.erase(code.begin() + out, code.end());
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+using namespace std;
+
+// error codes produced while compiling or evaluating expressions
+enum err_code {
+    E_NONE,
+    E_UNEXP_SYMBOL,     // misplaced operator
+    E_UNEXP_SYMB,       // unsupported symbol
+    E_INVALID_REF,      // reference out of the table
+    E_CROSS_REF,        // cyclic reference
+    E_UNEXP_EXPR,       // operand is not a number
+    E_INFINITE,         // division by zero
+    E_UNKNOWN_OP,       // unsupported operator
+    E_WRONG_REF,        // reference to the malformed cell
+    E_OVERFLOW,         // integer result out of range (see --int64)
+    E_TIMEOUT           // not evaluated within the budget (see Budget)
+};
+
+// returns the error code as it is printed out
+const char* get_error_str(const err_code code);
+
+// enumerates supported operators ('+', '-', '*', '/')
+typedef enum { OP_NONE, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_UNKNOWN } oper;
+
+// single instruction of a compiled expression
+struct Instr {
+    enum opcode : unsigned char {
+        I_NUM,      // pushes number arg
+        I_REF,      // pushes value of the cell with relative index arg
+        I_TOUCH,    // resolves the cell with relative index arg,
+                    // discards its value
+        I_OPER,     // pops two operands, pushes the result of operator arg
+        I_ERROR,    // stops evaluation with error arg
+        I_RESULT    // stops evaluation with the value of the cell
+                    // with relative index arg
+    } code;
+    int arg;
+
+    Instr(const opcode c, const int a) : code(c), arg(a) { }
+
+    bool operator==(const Instr &other) const {
+        return code == other.code && arg == other.arg;
+    }
+};
+
+// Expression compiled into the instruction stream for the stack machine
+// (see Tokenizer::execute()). The machine never needs more than
+// MAX_STACK operands: operators are applied as soon as two operands are
+// available, operands beyond that are never used for the result.
+// Expression leaving other than one operand (e.g. =1A1) results in
+// the value of its last reference.
+// References are relative to the cell of the expression (the difference
+// of the cell indices), so the expression copied down the column
+// (e.g. =A1*B1, =A2*B2, ...) is compiled into the same program.
+struct Program {
+    static const int MAX_STACK = 2;
+
+    vector<Instr> m_code;
+
+    bool operator==(const Program &other) const {
+        return m_code == other.m_code;
+    }
+
+    // returns position of the k-th reference (I_REF or I_TOUCH)
+    int get_ref_pc(size_t k) const;
+
+    // hash of the instructions
+    size_t hash() const;
+};
+
+// Set of the distinct programs (shapes) of the expressions, each shape is
+// stored once and referred to by its id. As the references are relative
+// the expression copied down the column (e.g. =A1*B1, =A2*B2, ...) has
+// one shape however many cells it takes.
+class ShapeTable {
+    struct Hash {
+        size_t operator()(const Program &prog) const { return prog.hash(); }
+    };
+
+    // shapes with their ids, the nodes keep their addresses
+    unordered_map<Program, int, Hash> m_ids;
+    vector<const Program*> m_shapes;    // shapes indexed by id
+
+public:
+    // returns id of the shape, adds it if it is new
+    int intern(const Program &prog);
+
+    // shape with the given id
+    const Program& get(const int id) const {
+        return *m_shapes[id];
+    }
+
+    // number of distinct shapes
+    size_t size() const {
+        return m_shapes.size();
+    }
+};
+
+// Turns expressions text into programs with references resolved to
+// the indices of cells (row * cols + col) of the table of the given size
+// relative to the index of the cell of the expression
+class Compiler {
+    short m_rows;                   // number of rows(lines) in table
+    short m_cols;                   // number of columns in table
+
+    // checks that the char starts correct cell reference from the available
+    // range of cells
+    bool is_ref_candidate(const char c) const {
+        return ((m_cols <= 26 && (c >= 'A' && c <= 'A' + (m_cols - 1))) ||
+            (m_cols > 26 && m_cols <= 52 && (c >= 'a' &&
+                c <= 'a' + (m_cols - 26 - 1))));
+    }
+
+    // returns column number by alfabhetic representation
+    short get_col_by_char(const char c) const
+    {
+        return (m_cols <= 26) ? c - 'A' : ((m_cols > 26 && m_cols <= 52) ?
+            c - 'a' : -1);
+    }
+
+    // returns operator enum value by symbol
+    static oper get_operator(const char ch)
+    {
+        switch (ch) {
+        case '*': return OP_MUL;
+        case '/': return OP_DIV;
+        case '+': return OP_ADD;
+        case '-': return OP_SUB;
+        default: return OP_UNKNOWN;
+        }
+    }
+
+    // checks that the char is supported operator
+    static bool is_operator(const char ch) {
+        return OP_UNKNOWN != get_operator(ch);
+    }
+
+public:
+    // ctor
+    Compiler(const short rows, const short cols) : m_rows(rows),
+        m_cols(cols) { }
+
+    // compiles one expression (cell text including leading '=') of the
+    // cell with the given index into prog, its instructions are replaced;
+    // the text is not copied, so it may be a part of the input
+    void compile(const char *str, const size_t size, const int anchor,
+        Program &prog) const;
+    void compile(const string &str, const int anchor, Program &prog) const {
+        compile(str.data(), str.size(), anchor, prog);
+    }
+    // compiles one expression into new program
+    Program compile(const string &str, const int anchor) const {
+        Program prog;
+        compile(str, anchor, prog);
+        return prog;
+    }
+};
+
+// Passes over the compiled program which keep its strict left to right
+// evaluation: each operation is truncated to int and an operand which is
+// not a number is an error, so operations are never reordered or merged.
+// - the constant prefix (e.g. =4-3*2+A1) is folded into one number
+//   unless it results in an error or doesn't fit int;
+// - the operation with the identity (+0, -0, *1, /1) applied to the
+//   result of the previous operation, which is always a number, is
+//   removed (e.g. =A1*B1+0); the one applied to the reference is kept
+//   as it checks that the cell is a number.
+// The references are never removed, so the cells the program reads and
+// the errors they give are the same.
+class Optimizer {
+    size_t m_removed;               // instructions removed so far
+
+    // folds the constant prefix of the program
+    void fold_constants(Program &prog);
+    // removes the operations with the identity
+    void remove_identities(Program &prog);
+
+public:
+    // ctor
+    Optimizer() : m_removed(0) { }
+
+    // runs the passes over the program
+    void optimize(Program &prog) {
+        fold_constants(prog);
+        remove_identities(prog);
+    }
+
+    // number of instructions removed from all the programs
+    size_t get_removed() const {
+        return m_removed;
+    }
+
+    // counts the instructions removed by the other optimizer too (e.g.
+    // of another thread)
+    void merge(const Optimizer &other) {
+        m_removed += other.m_removed;
+    }
+};
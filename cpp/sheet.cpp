@@ -0,0 +1,115 @@
+#include "sheet.h"
+
+// ctor, creates the table of empty cells
+Sheet::Sheet(const short rows, const short cols) : m_rows(rows),
+    m_cols(cols), m_compiler(rows, cols), m_epoch(0) {
+    m_table = new string*[m_rows];
+    for (short i = 0; i < m_rows; i++) {
+        m_table[i] = new string[m_cols];
+    }
+
+    size_t n_cells = static_cast<size_t>(m_rows) * m_cols;
+    m_tokenizer.reset(new Tokenizer(m_rows, m_cols, m_table, vector<Expr>(),
+        m_shapes));
+    m_programs.assign(n_cells, nullptr);
+    m_dependents.resize(n_cells);
+    m_marks.assign(n_cells, 0);
+}
+
+Sheet::~Sheet() {
+    m_tokenizer.reset();
+    for (short i = 0; i < m_rows; i++) {
+        delete[] m_table[i];
+    }
+    delete[] m_table;
+}
+
+// changes the raw text of the cell
+// the references of the old expression are dropped from the reverse
+// dependencies and the ones of the new expression are added
+void Sheet::set_cell(const short row, const short col, const string &text) {
+    int idx = row * m_cols + col;
+
+    if (m_programs[idx]) {
+        for (const Instr &in : m_programs[idx]->m_code) {
+            if (in.code == Instr::I_REF || in.code == Instr::I_TOUCH) {
+                vector<int> &deps = m_dependents[idx + in.arg];
+                deps.erase(find(deps.begin(), deps.end(), idx));
+            }
+        }
+        m_programs[idx] = nullptr;
+    }
+
+    if (is_expression(text)) {
+        m_compiler.compile(text, idx, m_program);
+        m_optimizer.optimize(m_program);
+        m_programs[idx] = &m_shapes.get(m_shapes.intern(m_program));
+        m_table[row][col] = "=";
+        for (const Instr &in : m_programs[idx]->m_code) {
+            if (in.code == Instr::I_REF || in.code == Instr::I_TOUCH) {
+                m_dependents[idx + in.arg].push_back(idx);
+            }
+        }
+    }
+    else if (text.empty() || is_number(text) || is_string_literal(text)) {
+        m_table[row][col] = text;
+    }
+    else { // marking unsupported cells by error msg
+        m_table[row][col] = "#E_UNKNOWN";
+    }
+
+    m_tokenizer->set_program(idx, m_programs[idx]);
+    m_dirty.push_back(idx);
+}
+
+// reevaluates the changed cells and all the expressions which depend on
+// them; they are reevaluated in the order of the table as the whole
+// table is evaluated after loading. The ones which have timed out are
+// changed again for the next time.
+bool Sheet::recalc(const Options &opts) {
+    if (++m_epoch == 0) { // marks wrapped around
+        fill(m_marks.begin(), m_marks.end(), 0);
+        m_epoch = 1;
+    }
+
+    vector<int> cone;
+    for (int idx : m_dirty) {
+        if (m_marks[idx] != m_epoch) {
+            m_marks[idx] = m_epoch;
+            cone.push_back(idx);
+        }
+    }
+    for (size_t i = 0; i < cone.size(); i++) {
+        for (int dependent : m_dependents[cone[i]]) {
+            if (m_marks[dependent] != m_epoch) {
+                m_marks[dependent] = m_epoch;
+                cone.push_back(dependent);
+            }
+        }
+    }
+    m_dirty.clear();
+
+    std::sort(cone.begin(), cone.end());
+    m_tokenizer->update(cone, opts);
+    if (!m_tokenizer->is_exceeded()) {
+        return true;
+    }
+    for (int idx : cone) {
+        if (m_tokenizer->is_timed_out(idx)) {
+            m_dirty.push_back(idx);
+        }
+    }
+    return false;
+}
+
+// returns the value of the cell for printing out
+string Sheet::get_value(const short row, const short col) const {
+    const string &s = m_table[row][col];
+    if (is_string_literal(s)) {
+        return s.substr(1);
+    }
+    if (is_expression(s)) {
+        return m_tokenizer->get_value(make_pair(row, col));
+    }
+    return s;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+
+#include "eltab.h"
+
+// Table kept in memory together with its evaluated state. Cells are
+// changed one by one, recalc() then reevaluates only the expressions
+// which depend (directly or through other expressions) on the changed
+// cells, so the time of recalculation is proportional to the number of
+// the affected cells rather than to the size of the table.
+//
+// Example:
+//     Sheet sheet(2, 2);
+//     sheet.set_cell(0, 0, "12");
+//     sheet.set_cell(1, 0, "=A1*2");
+//     sheet.recalc();          // A2 = 24
+//     sheet.set_cell(0, 0, "5");
+//     sheet.recalc();          // only A2 is reevaluated, A2 = 10
+//
+// The budget of the recalculation (the deadline, the number of the
+// operations and the cancellation token) is given by the options; the
+// expressions not evaluated within it get #E_TIMEOUT and are
+// reevaluated by the next recalc().
+class Sheet {
+    short m_rows;                   // number of rows(lines) in table
+    short m_cols;                   // number of columns in table
+    string** m_table;               // raw data of the cells
+    Compiler m_compiler;
+    Optimizer m_optimizer;
+    ShapeTable m_shapes;            // programs of the expressions
+    Program m_program;              // program being compiled
+    unique_ptr<Tokenizer> m_tokenizer;
+
+    // shapes of the expressions indexed as the cells,
+    // nullptr for the cells which are not expressions
+    vector<const Program*> m_programs;
+    // for each cell the expressions referencing it (reverse dependencies)
+    vector<vector<int>> m_dependents;
+    // cells changed since the last recalc()
+    vector<int> m_dirty;
+
+    // marks of the cells visited by recalc() to avoid clearing them
+    vector<unsigned> m_marks;
+    unsigned m_epoch;
+
+public:
+    // ctor, creates the table of empty cells
+    Sheet(const short rows, const short cols);
+    ~Sheet();
+
+    Sheet(const Sheet&) = delete;
+    Sheet& operator=(const Sheet&) = delete;
+
+    // changes the raw text of the cell
+    void set_cell(const short row, const short col, const string &text);
+
+    // reevaluates the expressions depending on the changed cells within
+    // the budget given by the options, returns false if it ran out
+    bool recalc(const Options &opts = Options());
+
+    // returns the value of the cell for printing out
+    string get_value(const short row, const short col) const;
+};
@@ -0,0 +1,194 @@
+#include "stream.h"
+
+// the tokenizer keeps the window and at least this many rows more, so
+// the rows are moved up once per that many rows read
+static const int MIN_STEP = 64;
+
+// checks that the instruction references a cell
+static bool is_ref(const Instr &in) {
+    return in.code == Instr::I_REF || in.code == Instr::I_TOUCH ||
+        in.code == Instr::I_RESULT;
+}
+
+// ctor, the tokenizer keeps the window, the current row and the rows
+// moved up at once
+Stream::Stream(const short rows, const short cols, const short window,
+    const Options &opts, const bool verbose) : m_rows(rows), m_cols(cols),
+    m_window(window), m_compiler(rows, cols), m_opts(opts),
+    m_verbose(verbose), m_row(0), m_top(0), m_outside(0) {
+    // the budget would start over for each row, so it isn't applied
+    m_opts.deadline_ms = 0;
+    m_opts.max_ops = 0;
+    m_opts.cancel = nullptr;
+    int height = window + 1 + max(window + 1, MIN_STEP);
+    m_height = static_cast<short>(min(height, static_cast<int>(rows)));
+    m_table = new string*[m_height];
+    for (short i = 0; i < m_height; i++) {
+        m_table[i] = new string[m_cols];
+    }
+    m_tokenizer.reset(new Tokenizer(m_height, m_cols, m_table,
+        vector<Expr>(), m_shapes));
+}
+
+Stream::~Stream() {
+    m_tokenizer.reset();
+    for (short i = 0; i < m_height; i++) {
+        delete[] m_table[i];
+    }
+    delete[] m_table;
+}
+
+// fills out each line as main() does into the row below the window,
+// the expressions are compiled with the references relative to their
+// cells, which stay the same as the rows are moved up
+void Stream::add_lines(const InputText &input, const size_t begin,
+    const size_t end) {
+    TableScanner scanner(input, begin, end);
+    TextView line;
+    vector<int> expressions;
+    while (m_row <= m_rows && scanner.get_line(line))
+    {
+        if (m_row == m_rows) {
+            if (m_verbose) {
+                cerr << "Warning: More lines than expected."
+                    "Skipping the remaining lines" << endl;
+            }
+            m_row++; // the rest is skipped silently
+            break;
+        }
+
+        if (m_verbose) {
+            int cols_count = count_if(line.data, line.data + line.size,
+                ::isspace) + 1;
+            if (cols_count > m_cols) {
+                cerr << "Warning: Extra columns detected in line #"
+                    << m_row + 1 << " Skipping..." << endl;
+            }
+        }
+
+        short slot = static_cast<short>(m_row - m_top);
+        if (slot == m_height) {
+            // only the window is kept, the rows above it are dropped
+            short shift = m_height - m_window;
+            m_tokenizer->shift_rows(shift);
+            rotate(m_table, m_table + shift, m_table + m_height);
+            for (short i = m_window; i < m_height; i++) {
+                for (short j = 0; j < m_cols; j++) {
+                    m_table[i][j].clear();
+                }
+            }
+            m_top += shift;
+            slot = m_window;
+        }
+
+        // the extra cells are skipped, the missing ones are left empty
+        expressions.clear();
+        short count = static_cast<short>(min(scanner.get_cells(),
+            static_cast<size_t>(m_cols)));
+        for (short j = 0; j < count; j++)
+        {
+            TextView data = scanner.get_cell(j);
+            int idx = slot * m_cols + j;
+
+            if (is_expression(data)) {
+                int anchor = m_row * m_cols + j;
+                m_compiler.compile(data.data, data.size, anchor, m_program);
+                // the reference out of the window stops the expression
+                // as the one out of the table does
+                vector<Instr> &code = m_program.m_code;
+                for (size_t pc = 0; pc < code.size(); pc++) {
+                    if (!is_ref(code[pc])) {
+                        continue;
+                    }
+                    int row = (anchor + code[pc].arg) / m_cols;
+                    if (row < m_row - m_window || row > m_row) {
+                        code.erase(code.begin() + pc, code.end());
+                        code.push_back(Instr(Instr::I_ERROR, E_INVALID_REF));
+                        m_outside++;
+                        break;
+                    }
+                }
+                if (m_opts.optimize) {
+                    m_optimizer.optimize(m_program);
+                }
+                m_tokenizer->set_program(idx,
+                    &m_shapes.get(m_shapes.intern(m_program)));
+                m_table[slot][j] = "=";
+                expressions.push_back(idx);
+            }
+            else if (data.empty() || is_number(data) ||
+                is_string_literal(data)) {
+                m_table[slot][j].assign(data.data, data.size);
+            }
+            else { // marking unsupported cells by error msg
+                m_table[slot][j] = "#E_UNKNOWN";
+            }
+        }
+
+        eval_row(slot, expressions);
+        m_row++;
+    }
+}
+
+// evaluates the expressions of the row, the rows above it are already
+// evaluated, and prints it out as main() does
+void Stream::eval_row(const short slot, const vector<int> &expressions) {
+    m_tokenizer->update(expressions, m_opts);
+    const vector<bool> &output = m_opts.output;
+    for (short j = 0; j < m_cols; j++) {
+        if (!output.empty() && !output[j])
+            continue;
+        const string &cell = m_table[slot][j];
+        if (is_string_literal(cell))
+            cout << cell.substr(1) << '\t';
+        else if (is_expression(cell))
+            cout << m_tokenizer->get_value(make_pair(slot, j)) << '\t';
+        else
+            cout << cell << '\t';
+    }
+    cout << endl;
+}
+
+void Stream::finish() {
+    for (; m_row < m_rows; m_row++) {
+        for (short j = 0; j < m_cols; j++) {
+            if (m_opts.output.empty() || m_opts.output[j])
+                cout << '\t';
+        }
+        cout << endl;
+    }
+}
+
+// compiles the expressions of the lines and looks at the rows of their
+// references
+int Stream::find_window(const InputText &input, const size_t begin,
+    const size_t end, const short rows, const short cols) {
+    Compiler compiler(rows, cols);
+    Program program;
+    TableScanner scanner(input, begin, end);
+    TextView line;
+    int window = 0;
+    for (int row = 0; row < rows && scanner.get_line(line); row++) {
+        short count = static_cast<short>(min(scanner.get_cells(),
+            static_cast<size_t>(cols)));
+        for (short j = 0; j < count; j++) {
+            TextView data = scanner.get_cell(j);
+            if (!is_expression(data)) {
+                continue;
+            }
+            int anchor = row * cols + j;
+            compiler.compile(data.data, data.size, anchor, program);
+            for (const Instr &in : program.m_code) {
+                if (!is_ref(in)) {
+                    continue;
+                }
+                int ref = (anchor + in.arg) / cols;
+                if (ref > row) {
+                    return -1;
+                }
+                window = max(window, row - ref);
+            }
+        }
+    }
+    return window;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+
+#include "eltab.h"
+#include "input.h"
+
+// Evaluation of the table row by row as it is read (--stream), for the
+// tables whose expressions reference only the cells of their own row
+// and of at most the window of rows before it (e.g. the logs with
+// running totals). Only the rows of the window are kept: each row is
+// evaluated as soon as it is read, printed out and dropped once it
+// falls out of the window, so the table of any length is evaluated in
+// the memory of the window.
+//     Stream stream(rows, cols, window, opts, verbose);
+//     stream.add_lines(input, begin, end);    // evaluated, printed out
+//     stream.finish();                        // rows the input lacks
+// The kept rows are the rows of the Tokenizer, which are moved up (see
+// Tokenizer::shift_rows()) when the bottom is reached. The reference to
+// the later row or to the row before the window gives #E_INVALID_REF.
+class Stream {
+    short m_rows;                   // number of rows(lines) in table
+    short m_cols;                   // number of columns in table
+    short m_window;                 // rows kept before the current one
+    short m_height;                 // rows of the tokenizer
+    string** m_table;               // raw data of the kept rows
+    Compiler m_compiler;
+    Optimizer m_optimizer;
+    ShapeTable m_shapes;            // programs of the expressions
+    Program m_program;              // program being compiled
+    unique_ptr<Tokenizer> m_tokenizer;
+    Options m_opts;
+    bool m_verbose;                 // inconsistencies are reported
+    int m_row;                      // rows read
+    short m_top;                    // row of the table at the top
+    size_t m_outside;               // references outside the window
+
+    // evaluates and prints out the row of the tokenizer
+    void eval_row(const short slot, const vector<int> &expressions);
+
+public:
+    // ctor, the window is the number of rows before the current one the
+    // expressions may reference; only the integer mode, the
+    // optimization and the printed columns of the options are used
+    Stream(const short rows, const short cols, const short window,
+        const Options &opts, const bool verbose);
+    ~Stream();
+
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    // evaluates and prints out the lines of the input in [begin, end),
+    // the lines beyond the rows of the table are skipped
+    void add_lines(const InputText &input, const size_t begin,
+        const size_t end);
+
+    // prints out the rows the input lacks as empty
+    void finish();
+
+    // number of references to the cells outside the window
+    size_t get_outside() const {
+        return m_outside;
+    }
+    // number of instructions removed by the optimizer
+    size_t get_removed() const {
+        return m_optimizer.get_removed();
+    }
+
+    // works out the window of the lines of the input in [begin, end):
+    // the greatest number of rows the expressions reference back,
+    // -1 if some of them references the later row
+    static int find_window(const InputText &input, const size_t begin,
+        const size_t end, const short rows, const short cols);
+};
@@ -0,0 +1,292 @@
+// Checks that the binary table (see BinaryTable) is loaded back as it is
+// written and that the malformed one is rejected, also when its
+// checksum is valid as anyone can work it out.
+#include <cstring>
+#include <fstream>
+#include <cstdio>
+
+#include "binary.h"
+
+static int failures = 0;
+
+// offsets of the fields of the header and of the first section
+const size_t CHECKSUM = 8;
+const size_t SHAPES = 24;
+const size_t STRINGS_SIZE = 32;
+const size_t HEADER = 40;
+
+static size_t align(const size_t offset) {
+    return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+// writes the table of the texts as main() fills it out, returns the file
+static string write_table(const short rows, const short cols,
+    const vector<string> &texts)
+{
+    string **cells = new string*[rows];
+    for (short i = 0; i < rows; i++) {
+        cells[i] = new string[cols];
+    }
+    vector<Expr> expressions;
+    Compiler compiler(rows, cols);
+    ShapeTable shapes;
+    Program program;
+    for (short i = 0; i < rows; i++) {
+        for (short j = 0; j < cols; j++) {
+            const string &text = texts[i * cols + j];
+            if (is_expression(text)) {
+                compiler.compile(text, i * cols + j, program);
+                expressions.push_back(Expr(make_pair(i, j),
+                    shapes.intern(program)));
+                cells[i][j] = "=";
+            }
+            else {
+                cells[i][j] = text;
+            }
+        }
+    }
+
+    const string path = "binary_test.eltb";
+    if (!BinaryTable::write(path, rows, cols, cells, expressions, shapes)) {
+        cerr << "binary_test: can't write " << path << endl;
+        failures++;
+    }
+    ifstream in(path, ios::binary);
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    in.close();
+    remove(path.c_str());
+
+    for (short i = 0; i < rows; i++) {
+        delete[] cells[i];
+    }
+    delete[] cells;
+    return data;
+}
+
+// works out the checksum again after the contents are changed
+static void seal(string &data) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = HEADER; i < data.size(); i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) *
+            1099511628211ull;
+    }
+    memcpy(&data[CHECKSUM], &hash, sizeof(hash));
+}
+
+template <typename T>
+static T get(const string &data, const size_t offset) {
+    T value;
+    memcpy(&value, &data[offset], sizeof(value));
+    return value;
+}
+
+template <typename T>
+static void set(string &data, const size_t offset, const T value) {
+    memcpy(&data[offset], &value, sizeof(value));
+}
+
+// offset of the first instruction of the code (see BinaryTable::Layout)
+static size_t get_code(const string &data, const size_t n_cells) {
+    size_t values = align(HEADER + n_cells);
+    return align(values + n_cells * sizeof(uint64_t) +
+        (get<uint32_t>(data, SHAPES) + size_t(1)) * sizeof(uint32_t));
+}
+
+// loads the table as main() does, returns the texts of the cells or
+// sets the error
+static bool load_table(const string &data, vector<string> &texts,
+    string &error)
+{
+    InputText input;
+    istringstream in(data);
+    input.read(in);
+    BinaryTable binary(input);
+    if (!binary.is_binary()) {
+        error = "not binary";
+        return false;
+    }
+    if (!binary.validate(error)) {
+        return false;
+    }
+    short rows = binary.get_rows(), cols = binary.get_cols();
+    string **cells = new string*[rows];
+    for (short i = 0; i < rows; i++) {
+        cells[i] = new string[cols];
+    }
+    vector<Expr> expressions;
+    ShapeTable shapes;
+    Optimizer optimizer;
+    bool loaded = binary.load(cells, expressions, shapes, optimizer, true,
+        error);
+    texts.clear();
+    for (short i = 0; i < rows; i++) {
+        for (short j = 0; j < cols; j++) {
+            texts.push_back(cells[i][j]);
+        }
+        delete[] cells[i];
+    }
+    delete[] cells;
+    return loaded;
+}
+
+static void expect_loaded(const string &name, const string &data,
+    const vector<string> &expected)
+{
+    vector<string> texts;
+    string error;
+    if (!load_table(data, texts, error)) {
+        cerr << name << ": rejected (" << error << ")" << endl;
+        failures++;
+    }
+    else if (texts != expected) {
+        cerr << name << ": the cells differ" << endl;
+        failures++;
+    }
+}
+
+static void expect_rejected(const string &name, const string &data) {
+    vector<string> texts;
+    string error;
+    if (load_table(data, texts, error)) {
+        cerr << name << ": loaded" << endl;
+        failures++;
+    }
+}
+
+// the strings of the cells: the offset or the length out of the blob
+static void test_strings() {
+    // no string, the blob is empty
+    string data = write_table(2, 2, { "12", "=A1+1", "", "007" });
+    if (get<uint64_t>(data, STRINGS_SIZE) != 0 &&
+        get<uint64_t>(data, STRINGS_SIZE) != 7) {
+        cerr << "strings: unexpected size of the blob" << endl;
+        failures++;
+    }
+    expect_loaded("no strings", data, { "12", "=", "", "007" });
+
+    data = write_table(2, 2, { "12", "=A1+1", "", "5" });
+    string bad = data;
+    bad[HEADER] = BinaryTable::K_TEXT;
+    set<uint64_t>(bad, align(HEADER + 4), uint64_t(1) << 40);
+    seal(bad);
+    expect_rejected("empty blob", bad);
+
+    // the blob shorter than the length of the string
+    bad = data + string(2, '\0');
+    set<uint64_t>(bad, STRINGS_SIZE, 2);
+    bad[HEADER] = BinaryTable::K_TEXT;
+    set<uint64_t>(bad, align(HEADER + 4), 0);
+    seal(bad);
+    expect_rejected("short blob", bad);
+
+    data = write_table(1, 2, { "'abc", "'abc" });
+    expect_loaded("strings", data, { "'abc", "'abc" });
+    bad = data;
+    set<uint64_t>(bad, align(HEADER + 2), 1); // inside the length
+    seal(bad);
+    expect_rejected("string out of the blob", bad);
+    bad = data;
+    set<uint32_t>(bad, bad.size() - 8, 5); // longer than the blob
+    seal(bad);
+    expect_rejected("long string", bad);
+}
+
+// the programs: the errors, the references and the stack
+static void test_programs() {
+    string data = write_table(1, 2, { "1", "=A1+1" });
+    expect_loaded("program", data, { "1", "=" });
+    size_t code = get_code(data, 2);
+    size_t end = data.size() - get<uint64_t>(data, STRINGS_SIZE);
+    size_t last = end - 8; // the operator of =A1+1
+
+    string bad = data;
+    set<int32_t>(bad, last, Instr::I_ERROR);
+    set<int32_t>(bad, last + 4, E_UNKNOWN_OP);
+    seal(bad);
+    expect_loaded("known error", bad, { "1", "=" });
+    set<int32_t>(bad, last + 4, 99);
+    seal(bad);
+    expect_rejected("unknown error", bad);
+    set<int32_t>(bad, last + 4, E_NONE);
+    seal(bad);
+    expect_rejected("no error", bad);
+
+    bad = data;
+    set<int32_t>(bad, last + 4, 42);
+    seal(bad);
+    expect_rejected("unknown operator", bad);
+
+    bad = data;
+    set<int32_t>(bad, code, Instr::I_NUM); // three operands
+    set<int32_t>(bad, last, Instr::I_NUM);
+    seal(bad);
+    expect_rejected("stack overflow", bad);
+
+    bad = data;
+    set<int32_t>(bad, code + 4, 100);
+    seal(bad);
+    expect_rejected("reference out of the table", bad);
+
+    // the reference beyond the full stack is touched, the result is the
+    // value of the last reference: A1 B1 touch(C1) result(C1)
+    data = write_table(1, 4, { "1", "2", "3", "=A1B1C1" });
+    expect_loaded("touch", data, { "1", "2", "3", "=" });
+    code = get_code(data, 4);
+    if (get<int32_t>(data, code + 16) != Instr::I_TOUCH ||
+        get<int32_t>(data, code + 24) != Instr::I_RESULT) {
+        cerr << "touch: unexpected program" << endl;
+        failures++;
+    }
+
+    bad = data;
+    set<int32_t>(bad, code + 28, -3); // A1, not the last reference
+    seal(bad);
+    expect_rejected("result of another cell", bad);
+
+    bad = data;
+    set<int32_t>(bad, code, Instr::I_TOUCH); // with the stack empty
+    seal(bad);
+    expect_rejected("touch before the full stack", bad);
+
+    bad = data;
+    set<int32_t>(bad, code + 8, Instr::I_RESULT); // before the end
+    seal(bad);
+    expect_rejected("result not last", bad);
+
+    bad = data;
+    set<int32_t>(bad, code + 24, Instr::I_OPER); // after the touch
+    set<int32_t>(bad, code + 28, OP_ADD);
+    seal(bad);
+    expect_rejected("operator after the touch", bad);
+
+    bad = data;
+    set<int32_t>(bad, code + 16, Instr::I_ERROR); // before the result
+    set<int32_t>(bad, code + 20, E_UNKNOWN_OP);
+    seal(bad);
+    expect_rejected("error not last", bad);
+}
+
+// the header: the version, the checksum and the sizes
+static void test_header() {
+    string data = write_table(1, 1, { "'x" });
+    string bad = data;
+    bad[4] = 2;
+    expect_rejected("version", bad);
+    bad = data;
+    bad[HEADER] = BinaryTable::K_NUMBER;
+    expect_rejected("checksum", bad);
+    expect_rejected("truncated", data.substr(0, data.size() - 1));
+    expect_rejected("header only", data.substr(0, HEADER));
+}
+
+int main() {
+    test_strings();
+    test_programs();
+    test_header();
+    if (failures > 0) {
+        cerr << "binary_test: " << failures << " failures" << endl;
+        return 1;
+    }
+    cout << "binary_test: passed" << endl;
+    return 0;
+}
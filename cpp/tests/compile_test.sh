@@ -0,0 +1,37 @@
+#!/bin/sh
+# Checks that the sheet compiled by --compile gives the same values as
+# the usual evaluation, when it is built and when it is used again, also
+# for the table whose referenced cell has changed from a string to a
+# number (the expressions are the same, so the same sheet is used).
+# Usage: tests/compile_test.sh path/to/eltab
+ELTAB=${1:?path of eltab}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+printf "2\t3\n'x\t=A1+1\t=B1\n5\t=A2*2\t=A1\n" > "$DIR/text.elt"
+printf "2\t3\n7\t=A1+1\t=B1\n5\t=A2*2\t=A1\n" > "$DIR/number.elt"
+printf "3\t4\n12\t=C2\t3\t'Sample\n=A1+B1*C1/5\t=A2*B1\t=B3-C3\t'Spread\n'Test\t=4-3\t5\t'Sheet\n" \
+    > "$DIR/sample.elt"
+
+failed=0
+for engine in serial levels steal demand frames; do
+    export ELTAB_CACHE="$DIR/cache-$engine"
+    for table in text text number sample sample; do
+        "$ELTAB" "$DIR/$table.elt" > "$DIR/expected"
+        "$ELTAB" --compile --stats --engine $engine "$DIR/$table.elt" \
+            > "$DIR/actual" 2> "$DIR/stats"
+        if ! grep -q "compiled sheet: \(built\|used\)" "$DIR/stats"; then
+            echo "compile_test: the sheet is not compiled, skipped"
+            exit 0
+        fi
+        if ! cmp -s "$DIR/expected" "$DIR/actual"; then
+            echo "compile_test: $table --engine $engine" \
+                "($(grep "compiled sheet" "$DIR/stats")) differs:"
+            diff "$DIR/expected" "$DIR/actual"
+            failed=1
+        fi
+    done
+done
+
+[ $failed -eq 0 ] && echo "compile_test: passed"
+exit $failed
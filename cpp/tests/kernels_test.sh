@@ -0,0 +1,78 @@
+#!/bin/sh
+# Checks that the column kernel (its AVX2 and scalar lanes) and the
+# native code give the same values as the interpreter evaluating the
+# expressions one by one, for the operations out of the range of int
+# (INT_MIN), the operands which are not numbers (NaN in the kernel) and
+# the division by zero.
+# Usage: tests/kernels_test.sh path/to/eltab
+ELTAB=${1:?path of eltab}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# the cells A and B of the cases, the expressions are copied down
+set -- "2147483647	2" "0	0" "5	0" "'x	3" "	4" "2000000000	2000000000" \
+    "7	3" "3000000000	1" "1	'y" "2147483647	2147483647" "100	7"
+CASES=$#
+
+failed=0
+# each case is moved through the rows, so it gets to the AVX2 lanes
+# (four at a time) and to the scalar ones left after them
+shift=0
+while [ $shift -lt $CASES ]; do
+    table="$DIR/table$shift.elt"
+    printf '%d\t8\n' $CASES > "$table"
+    row=1
+    while [ $row -le $CASES ]; do
+        k=$(( (row - 1 + shift) % CASES + 1 ))
+        eval "cells=\${$k}"
+        printf '%s\t=A%d*B%d\t=A%d/B%d\t=A%d+B%d*2-1\t=A%d-B%d/B%d\t=C%d*2\t=D%d+1\n' \
+            "$cells" $row $row $row $row $row $row $row $row $row $row \
+            $row >> "$table"
+        row=$((row + 1))
+    done
+
+    for mode in "" "--int64"; do
+        "$ELTAB" $mode --backend interp --no-columns < "$table" \
+            > "$DIR/expected" 2>&1
+        for options in "" "--backend jit --no-columns" "--backend jit"; do
+            "$ELTAB" $mode $options < "$table" > "$DIR/actual" 2>&1
+            if ! cmp -s "$DIR/expected" "$DIR/actual"; then
+                echo "kernels_test: $table $mode $options differs:"
+                diff "$DIR/expected" "$DIR/actual"
+                failed=1
+            fi
+        done
+    done
+    shift=$((shift + 1))
+done
+
+# the run which only partly fits --max-ops is evaluated up to the limit
+# as the expressions one by one are
+table="$DIR/budget.elt"
+printf '20\t2\n' > "$table"
+row=1
+while [ $row -le 20 ]; do
+    printf '%d\t=A%d*2\n' $row $row >> "$table"
+    row=$((row + 1))
+done
+for mode in "" "--int64"; do
+    "$ELTAB" $mode --max-ops 25 --no-columns < "$table" > "$DIR/expected" 2>&1
+    "$ELTAB" $mode --max-ops 25 < "$table" > "$DIR/actual" 2>&1
+    if ! cmp -s "$DIR/expected" "$DIR/actual" ||
+        ! grep -q "^8	16" "$DIR/actual"; then
+        echo "kernels_test: $table $mode --max-ops 25 differs:"
+        diff "$DIR/expected" "$DIR/actual"
+        failed=1
+    fi
+done
+
+# the kernel and the native code are used at all
+"$ELTAB" --stats < "$DIR/table0.elt" 2>&1 >/dev/null |
+    grep -q "column kernel: [1-9]" || {
+    echo "kernels_test: the column kernel is not used"; failed=1; }
+"$ELTAB" --stats --backend jit --no-columns < "$DIR/table0.elt" 2>&1 \
+    >/dev/null | grep -q "native code: [1-9]" || {
+    echo "kernels_test: the native code is not used"; failed=1; }
+
+[ $failed -eq 0 ] && echo "kernels_test: passed"
+exit $failed
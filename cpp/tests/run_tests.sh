@@ -0,0 +1,31 @@
+#!/bin/sh
+# Builds eltab (also as C++14 without the optimization, so the sources
+# stay C++14 and link at -O0) and the test programs into the given
+# directory (a temporary one by default) and runs the tests:
+#     tests/*_test.cpp    programs linked with the sources of eltab, run
+#                         in the build directory
+#     tests/*_test.sh     scripts run with the path of eltab
+# Usage: tests/run_tests.sh [build directory]
+set -e
+OUT=${1:-$(mktemp -d)}
+mkdir -p "$OUT"
+OUT=$(cd "$OUT" && pwd)
+cd "$(dirname "$0")/.."
+CXX=${CXX:-g++}
+FLAGS="-std=c++17 -O2 -pthread"
+SOURCES=$(ls *.cpp | grep -v '^eltab\.cpp$')
+
+$CXX $FLAGS -o "$OUT/eltab" *.cpp -ldl
+$CXX -std=c++14 -O0 -pthread -o "$OUT/eltab_cxx14" *.cpp -ldl
+failed=0
+for test in tests/*_test.cpp; do
+    [ -e "$test" ] || continue
+    name=$(basename "$test" .cpp)
+    $CXX $FLAGS -I. -o "$OUT/$name" "$test" $SOURCES -ldl
+    (cd "$OUT" && "./$name") || failed=1
+done
+for test in tests/*_test.sh; do
+    [ -e "$test" ] || continue
+    sh "$test" "$OUT/eltab" || failed=1
+done
+exit $failed
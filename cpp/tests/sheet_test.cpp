@@ -0,0 +1,237 @@
+// Checks the incremental recalculation of Sheet: after each series of
+// edits the values given by recalc() must be the same as the ones of the
+// edited table evaluated from scratch the way main() does.
+#include <random>
+
+#include "sheet.h"
+
+static int failures = 0;
+
+// evaluates the table of the texts (indexed as the cells) from scratch
+static vector<string> eval_full(const short rows, const short cols,
+    const vector<string> &texts)
+{
+    string **cells = new string*[rows];
+    for (short i = 0; i < rows; i++) {
+        cells[i] = new string[cols];
+    }
+    vector<Expr> expressions;
+    Compiler compiler(rows, cols);
+    Optimizer optimizer;
+    ShapeTable shapes;
+    Program program;
+    for (short i = 0; i < rows; i++) {
+        for (short j = 0; j < cols; j++) {
+            const string &text = texts[i * cols + j];
+            if (is_expression(text)) {
+                compiler.compile(text, i * cols + j, program);
+                optimizer.optimize(program);
+                expressions.push_back(Expr(make_pair(i, j),
+                    shapes.intern(program)));
+                cells[i][j] = "=";
+            }
+            else if (text.empty() || is_number(text) ||
+                is_string_literal(text)) {
+                cells[i][j] = text;
+            }
+            else {
+                cells[i][j] = "#E_UNKNOWN";
+            }
+        }
+    }
+
+    vector<string> values;
+    {
+        Tokenizer tokenizer(rows, cols, cells, expressions, shapes);
+        tokenizer.run(Options());
+        for (short i = 0; i < rows; i++) {
+            for (short j = 0; j < cols; j++) {
+                const string &s = cells[i][j];
+                if (is_string_literal(s))
+                    values.push_back(s.substr(1));
+                else if (is_expression(s))
+                    values.push_back(tokenizer.get_value(make_pair(i, j)));
+                else
+                    values.push_back(s);
+            }
+        }
+    }
+    for (short i = 0; i < rows; i++) {
+        delete[] cells[i];
+    }
+    delete[] cells;
+    return values;
+}
+
+// compares the values of the sheet with the ones evaluated from scratch
+static void check(const string &name, const Sheet &sheet, const short rows,
+    const short cols, const vector<string> &texts)
+{
+    vector<string> expected = eval_full(rows, cols, texts);
+    for (short i = 0; i < rows; i++) {
+        for (short j = 0; j < cols; j++) {
+            string value = sheet.get_value(i, j);
+            if (value != expected[i * cols + j]) {
+                cerr << name << ": " << get_cell_by_coords(make_pair(i, j))
+                    << " is '" << value << "', expected '"
+                    << expected[i * cols + j] << "'" << endl;
+                failures++;
+            }
+        }
+    }
+}
+
+// checks the value of the cell
+static void check_value(const string &name, const Sheet &sheet,
+    const short row, const short col, const string &expected)
+{
+    string value = sheet.get_value(row, col);
+    if (value != expected) {
+        cerr << name << ": " << get_cell_by_coords(make_pair(row, col))
+            << " is '" << value << "', expected '" << expected << "'"
+            << endl;
+        failures++;
+    }
+}
+
+// sheet together with the texts of its cells
+struct Edits {
+    short rows;
+    short cols;
+    Sheet sheet;
+    vector<string> texts;
+
+    Edits(const short rows, const short cols) : rows(rows), cols(cols),
+        sheet(rows, cols), texts(static_cast<size_t>(rows) * cols) { }
+
+    void set(const short row, const short col, const string &text) {
+        sheet.set_cell(row, col, text);
+        texts[row * cols + col] = text;
+    }
+};
+
+// adding and removing the references, creating and breaking the cycle
+static void test_edits() {
+    Edits e(3, 3);
+    e.set(0, 0, "12");
+    e.set(1, 0, "=A1*2");
+    e.set(2, 0, "=A2+A1");
+    e.sheet.recalc();
+    check("initial", e.sheet, e.rows, e.cols, e.texts);
+    check_value("initial", e.sheet, 2, 0, "36");
+
+    e.set(0, 0, "5");
+    e.sheet.recalc();
+    check("changed number", e.sheet, e.rows, e.cols, e.texts);
+    check_value("changed number", e.sheet, 2, 0, "15");
+
+    // A2 doesn't reference A1 any more, B1 does
+    e.set(1, 0, "=B1+1");
+    e.set(0, 1, "=A1-1");
+    e.sheet.recalc();
+    check("moved reference", e.sheet, e.rows, e.cols, e.texts);
+    e.set(0, 0, "7");
+    e.sheet.recalc();
+    check("removed reference", e.sheet, e.rows, e.cols, e.texts);
+    check_value("removed reference", e.sheet, 1, 0, "7");
+
+    // A1 -> B1 -> A1
+    e.set(0, 0, "=B1");
+    e.sheet.recalc();
+    check("cycle", e.sheet, e.rows, e.cols, e.texts);
+    check_value("cycle", e.sheet, 0, 0, "#E_CROSS_REF");
+    check_value("cycle", e.sheet, 2, 0, "#E_CROSS_REF");
+
+    e.set(0, 1, "'text");
+    e.sheet.recalc();
+    check("broken cycle", e.sheet, e.rows, e.cols, e.texts);
+    check_value("broken cycle", e.sheet, 0, 1, "text");
+
+    e.set(0, 1, "4");
+    e.sheet.recalc();
+    check("number again", e.sheet, e.rows, e.cols, e.texts);
+    check_value("number again", e.sheet, 2, 0, "9");
+
+    e.set(1, 1, "=C3/A1");
+    e.set(2, 2, "0");
+    e.sheet.recalc();
+    check("division by zero", e.sheet, e.rows, e.cols, e.texts);
+    e.set(2, 2, "");
+    e.set(1, 0, "");
+    e.sheet.recalc();
+    check("cleared cells", e.sheet, e.rows, e.cols, e.texts);
+}
+
+// the expressions not evaluated within the budget get #E_TIMEOUT and
+// are evaluated by the next recalc()
+static void test_timeout() {
+    Edits e(4, 2);
+    e.set(0, 0, "1");
+    e.set(1, 0, "=A1+1");
+    e.set(2, 0, "=A2+1");
+    e.set(3, 0, "=A3+1");
+    Options opts;
+    opts.max_ops = 1;
+    if (e.sheet.recalc(opts)) {
+        cerr << "timeout: recalc() within 1 operation succeeded" << endl;
+        failures++;
+    }
+    check_value("timeout", e.sheet, 3, 0, "#E_TIMEOUT");
+    e.sheet.recalc();
+    check("after timeout", e.sheet, e.rows, e.cols, e.texts);
+    check_value("after timeout", e.sheet, 3, 0, "4");
+
+    e.set(0, 0, "5");
+    e.set(0, 1, "=A4*2");
+    e.sheet.recalc(opts);
+    e.set(1, 1, "=B1-1");
+    e.sheet.recalc();
+    check("edited after timeout", e.sheet, e.rows, e.cols, e.texts);
+    check_value("edited after timeout", e.sheet, 1, 1, "15");
+}
+
+// random edits of the small table, so the cycles, the errors and the
+// references to the changed cells are frequent
+static void test_random() {
+    const short rows = 5, cols = 4;
+    Edits e(rows, cols);
+    mt19937 random(2024);
+    auto cell = [&]() {
+        return get_cell_by_coords(make_pair(
+            static_cast<short>(random() % (rows + 1)), // past the table too
+            static_cast<short>(random() % cols)));
+    };
+    const char *ops = "+-*/";
+    for (int step = 0; step < 3000; step++) {
+        const short row = static_cast<short>(random() % rows);
+        const short col = static_cast<short>(random() % cols);
+        string text;
+        switch (random() % 8) {
+        case 0: break;
+        case 1: text = to_string(random() % 10); break;
+        case 2: text = "'s" + to_string(random() % 3); break;
+        case 3: text = "x"; break;
+        case 4: text = "=" + cell(); break;
+        case 5: text = "=" + to_string(random() % 5) + ops[random() % 4] +
+            cell(); break;
+        default: text = "=" + cell() + ops[random() % 4] + cell(); break;
+        }
+        e.set(row, col, text);
+        if (random() % 3 == 0) {
+            e.sheet.recalc();
+            check("step " + to_string(step), e.sheet, rows, cols, e.texts);
+        }
+    }
+}
+
+int main() {
+    test_edits();
+    test_timeout();
+    test_random();
+    if (failures > 0) {
+        cerr << "sheet_test: " << failures << " failures" << endl;
+        return 1;
+    }
+    cout << "sheet_test: passed" << endl;
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+// ctor, threads is the total number of threads including the caller
+ThreadPool::ThreadPool(const unsigned threads) : m_job(nullptr),
+    m_count(0), m_next(0), m_busy(0), m_generation(0), m_stop(false) {
+    for (unsigned i = 1; i < threads; i++) {
+        m_workers.push_back(thread(&ThreadPool::worker, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto &w : m_workers) { w.join(); }
+}
+
+// runs iterations of the current loop until there are none left
+void ThreadPool::work() {
+    for (;;) {
+        size_t begin = m_next.fetch_add(CHUNK);
+        if (begin >= m_count) {
+            break;
+        }
+        size_t end = min(begin + CHUNK, m_count);
+        for (size_t i = begin; i < end; i++) {
+            (*m_job)(i);
+        }
+    }
+}
+
+// worker thread body
+void ThreadPool::worker() {
+    unsigned seen = 0;
+    for (;;) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop) {
+                return;
+            }
+            seen = m_generation;
+        }
+
+        work();
+
+        lock_guard<mutex> lock(m_mutex);
+        if (--m_busy == 0) {
+            m_done.notify_one();
+        }
+    }
+}
+
+// calls fn(i) for each i in [0, count) on all threads of the pool
+// loops too short to be shared are run by the caller alone
+void ThreadPool::parallel_for(const size_t count,
+    const function<void(size_t)> &fn) {
+    if (m_workers.empty() || count <= CHUNK) {
+        for (size_t i = 0; i < count; i++) { fn(i); }
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_job = &fn;
+        m_count = count;
+        m_next = 0;
+        m_busy = m_workers.size();
+        ++m_generation;
+    }
+    m_wake.notify_all();
+
+    work();
+
+    unique_lock<mutex> lock(m_mutex);
+    m_done.wait(lock, [&] { return m_busy == 0; });
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+// Fixed set of worker threads running parallel loops. The thread calling
+// parallel_for() takes part in the loop, so the pool of N threads starts
+// N - 1 workers.
+class ThreadPool {
+    // number of loop iterations taken by a thread at once
+    static const size_t CHUNK = 64;
+
+    vector<thread> m_workers;
+    mutex m_mutex;
+    condition_variable m_wake;      // signals workers about new loop
+    condition_variable m_done;      // signals the caller about finished loop
+
+    const function<void(size_t)> *m_job;  // body of the current loop
+    size_t m_count;                 // number of iterations of the loop
+    atomic<size_t> m_next;          // next iteration to take
+    size_t m_busy;                  // workers still running the loop
+    unsigned m_generation;          // number of loops started
+    bool m_stop;                    // pool is being destroyed
+
+    // runs iterations of the current loop until there are none left
+    void work();
+    // worker thread body
+    void worker();
+
+public:
+    // ctor, threads is the total number of threads including the caller
+    explicit ThreadPool(const unsigned threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // calls fn(i) for each i in [0, count) on all threads of the pool,
+    // returns when all the calls are done
+    void parallel_for(const size_t count, const function<void(size_t)> &fn);
+
+    // total number of threads including the caller
+    unsigned size() const {
+        return static_cast<unsigned>(m_workers.size()) + 1;
+    }
+};
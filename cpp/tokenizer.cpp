@@ -0,0 +1,491 @@
+#include "eltab.h"
+
+// starts the process of the parsing/evaluation of expressions
+// only the expressions printed out are the roots of the order, so the
+// ones not referenced by the printed expressions are never evaluated
+void Tokenizer::run(const Options &opts) {
+    m_int64 = opts.int64;
+    m_resolve = !opts.compile;
+    m_budget.start(opts.deadline_ms, opts.max_ops, opts.cancel);
+    vector<int> roots;
+    roots.reserve(m_expressions.size());
+    for (auto &ex : m_expressions) {
+        if (opts.output.empty() || opts.output[ex.m_coords.second]) {
+            roots.push_back(static_cast<int>(get_index(ex.m_coords)));
+        }
+    }
+    auto count_dead = [&]() {
+        m_dead_cells = 0;
+        for (auto &ex : m_expressions) {
+            m_dead_cells += (m_cells[get_index(ex.m_coords)].state ==
+                CellValue::S_UNVISITED);
+        }
+    };
+
+    // the order is worked out during the evaluation, so the passes
+    // which need it beforehand (shared prefixes and the column kernel)
+    // are skipped
+    if (opts.engine == Options::ENGINE_DEMAND ||
+        opts.engine == Options::ENGINE_FRAMES) {
+        m_order = roots;
+        compile_native(opts.backend);
+        m_order.clear();
+        if (opts.engine == Options::ENGINE_DEMAND) {
+            run_demand(opts.threads, roots);
+        }
+        else {
+            run_frames(opts.threads, roots);
+        }
+        count_dead();
+        return;
+    }
+
+    sort(roots);
+    count_dead();
+    if (opts.cse) {
+        share_prefixes();
+    }
+    if (opts.columns) {
+        run_columns();
+    }
+    compile_native(opts.backend);
+
+    Options::engine_t engine = opts.engine;
+    if (engine == Options::ENGINE_AUTO) {
+        engine = (opts.threads > 1) ? Options::ENGINE_LEVELS :
+            Options::ENGINE_SERIAL;
+    }
+    if (engine == Options::ENGINE_LEVELS) {
+        run_levels(opts.threads);
+        return;
+    }
+    if (engine == Options::ENGINE_STEALING) {
+        run_stealing(opts.threads);
+        return;
+    }
+
+    // all the cells referenced by the expression are evaluated before it
+    for (int idx : m_order) {
+        eval_cell(idx);
+    }
+}
+
+// compiles the shapes of the expressions left in the order into native
+// code: BACKEND_JIT compiles all of them, BACKEND_AUTO the ones used by
+// at least HOT_SHAPE expressions; the layout of the cells is taken
+// from the real cell. The native code works with doubles only, so there
+// is none in the integer mode.
+void Tokenizer::compile_native(const Options::backend_t backend) {
+    m_native.clear();
+    m_native_shapes = 0;
+    if (backend == Options::BACKEND_INTERP || m_int64 ||
+        !NativeCode::is_supported()) {
+        return;
+    }
+
+    vector<char> pending(m_cells.size(), 0);
+    for (int idx : m_order) { pending[idx] = 1; }
+    vector<int> uses(m_shapes.size(), 0);
+    for (auto &ex : m_expressions) {
+        uses[ex.m_shape] += pending[get_index(ex.m_coords)];
+    }
+    int hot = (backend == Options::BACKEND_JIT) ? 1 : HOT_SHAPE;
+    vector<const Program*> programs(m_shapes.size(), nullptr);
+    for (size_t s = 0; s < programs.size(); s++) {
+        if (uses[s] >= hot) {
+            programs[s] = &m_shapes.get(static_cast<int>(s));
+        }
+    }
+
+    CellValue cell;
+    const char *base = reinterpret_cast<const char*>(&cell);
+    NativeCode::Layout layout;
+    layout.stride = sizeof(CellValue);
+    layout.type_offset =
+        reinterpret_cast<const char*>(&cell.value.type) - base;
+    layout.type_size = sizeof(cell.value.type);
+    layout.number_type = Token::T_NUMBER;
+    layout.number_offset =
+        reinterpret_cast<const char*>(&cell.value.n_value) - base;
+
+    vector<NativeCode::function_t> functions =
+        m_native_code.compile(programs, layout);
+    for (auto fn : functions) {
+        m_native_shapes += (fn != nullptr);
+    }
+    if (m_native_shapes == 0) {
+        return;
+    }
+    m_native.assign(m_cells.size(), nullptr);
+    for (auto &ex : m_expressions) {
+        int idx = static_cast<int>(get_index(ex.m_coords));
+        if (pending[idx]) {
+            m_native[idx] = functions[ex.m_shape];
+        }
+    }
+}
+
+// evaluates one expression cell and stores its value
+// errors (references to malformed cells etc.) are stored as
+// error tokens; once the budget is exceeded, the cells get #E_TIMEOUT
+// (the ones they reference are evaluated before, so they are either
+// evaluated or have timed out too)
+void Tokenizer::eval_cell(const int idx) {
+    if (m_budget.is_active() &&
+        !m_budget.charge(m_programs[idx]->m_code.size())) {
+        m_cells[idx].value = Token(E_TIMEOUT);
+        return;
+    }
+    if (!m_shared.empty() && m_shared[idx].first >= 0) {
+        // the owner evaluates the prefix for all the expressions sharing it
+        SharedPrefix &shared = m_prefixes[m_shared[idx].first];
+        if (shared.owner == idx) {
+            shared.value = execute(shared.prefix, idx, m_stops[idx]);
+        }
+        m_cells[idx].value = (shared.value.type == Token::T_ERROR) ?
+            shared.value : execute(*m_programs[idx], idx, m_stops[idx],
+                m_shared[idx].second, shared.value);
+        return;
+    }
+    if (!m_native.empty() && m_native[idx] != nullptr &&
+        m_stops[idx].first < 0) {
+        double res;
+        int err = m_native[idx](
+            reinterpret_cast<const char*>(&m_cells[idx]), &res);
+        m_cells[idx].value = (err == E_NONE) ?
+            Token(static_cast<int>(res)) : Token(static_cast<err_code>(err));
+        return;
+    }
+    if (m_numeric[idx]) {
+        m_cells[idx].value = execute_numeric(*m_programs[idx], idx);
+        return;
+    }
+    m_cells[idx].value = execute(*m_programs[idx], idx, m_stops[idx]);
+}
+
+// Works out the order of evaluation and finds the cycles of references
+// in one depth-first traversal of the dependency graph (Tarjan's strongly
+// connected components), starting from the given expressions (in the
+// order they appear in the table) and following the references in the
+// order they appear in the expression. The traversal keeps its own stack,
+// so chains of references of any length are handled.
+// A component is complete when all the cells it references are, so the
+// components are put in order after all the cells they reference.
+// The cells of the component with more than one cell or referencing
+// itself (e.g. A1->B2->A1) are in the cycle, they and all the cells
+// depending on them get #E_CROSS_REF right away and are never evaluated.
+// A reference to malformed cell stops the evaluation of the referencing
+// expression with E_WRONG_REF at that point, the references following
+// such one are never visited.
+// The type of each expression is worked out as it is put in order, the
+// expression known to result in the error gets it right away instead
+// (see infer_type()).
+void Tokenizer::sort(const vector<int> &roots) {
+    struct Frame {
+        int cell;       // expression cell being traversed
+        const int *dep; // next reference to follow
+    };
+    vector<Frame> stack;
+    vector<int> component;  // cells of the components not complete yet
+    int visited = 0;
+
+    m_order.clear();
+    m_order.reserve(roots.size());
+    m_resolved_cells = 0;
+    m_numeric_cells = 0;
+
+    auto enter = [&](const int cell) {
+        m_cells[cell].state = CellValue::S_IN_PROGRESS;
+        m_visit[cell] = m_low[cell] = visited++;
+        component.push_back(cell);
+        stack.push_back(Frame{ cell, m_graph.deps_begin(cell) });
+    };
+
+    // the component of the cell is complete, the cells of the previous
+    // components it references already have their values or places
+    auto complete = [&](const int cell) {
+        auto first = find(component.begin(), component.end(), cell);
+        bool cycle = component.end() - first > 1;
+        for (auto it = first; it != component.end() && !cycle; ++it) {
+            for (const int *dep = m_graph.deps_begin(*it);
+                dep < m_graph.deps_end(*it) && !cycle; ++dep) {
+                if (m_programs[*dep] == nullptr &&
+                    m_cells[*dep].state != CellValue::S_DONE) {
+                    break; // malformed cell, the rest is never read
+                }
+                cycle = *dep == *it || is_cross_ref(*dep);
+            }
+        }
+        for (auto it = first; it != component.end(); ++it) {
+            m_cells[*it].state = CellValue::S_DONE;
+            if (cycle) {
+                m_cells[*it].value = Token(E_CROSS_REF);
+            }
+            else if (!infer_type(*it)) {
+                m_order.push_back(*it);
+            }
+        }
+        component.erase(first, component.end());
+    };
+
+    for (int root : roots) {
+        if (m_cells[root].state != CellValue::S_UNVISITED ||
+            m_programs[root] == nullptr) {
+            continue;
+        }
+
+        enter(root);
+        while (!stack.empty()) {
+            Frame &f = stack.back();
+
+            if (f.dep == m_graph.deps_end(f.cell)) {
+                int cell = f.cell;
+                stack.pop_back();
+                if (!stack.empty()) {
+                    int &low = m_low[stack.back().cell];
+                    low = min(low, m_low[cell]);
+                }
+                if (m_low[cell] == m_visit[cell]) {
+                    complete(cell);
+                }
+                continue;
+            }
+
+            int dep = *f.dep++;
+            CellValue &cell = m_cells[dep];
+            if (cell.state == CellValue::S_IN_PROGRESS) {
+                m_low[f.cell] = min(m_low[f.cell], m_visit[dep]);
+            }
+            else if (cell.state == CellValue::S_DONE) {
+                continue;
+            }
+            else if (m_programs[dep] != nullptr) {
+                enter(dep); // invalidates f
+            }
+            else if (!parse_reference(dep)) {
+                size_t k = f.dep - m_graph.deps_begin(f.cell) - 1;
+                m_stops[f.cell] = make_pair(
+                    m_programs[f.cell]->get_ref_pc(k), E_WRONG_REF);
+                f.dep = m_graph.deps_end(f.cell);
+            }
+        }
+    }
+}
+
+// replaces the program of the cell, its text is already changed
+void Tokenizer::set_program(const int idx, const Program *program) {
+    m_programs[idx] = program;
+    m_kinds[idx] = (program != nullptr) ? get_program_kind(*program) :
+        PK_OTHER;
+    if (!m_native.empty()) {
+        m_native[idx] = nullptr;
+    }
+    m_graph.update(idx, program);
+}
+
+// reevaluates the given cells: they are put back to unvisited state and
+// sorted again, the cells they reference keep their values unless they
+// are given too
+void Tokenizer::update(const vector<int> &cells, const Options &opts) {
+    m_int64 = opts.int64;
+    m_resolve = !opts.compile;
+    m_budget.start(opts.deadline_ms, opts.max_ops, opts.cancel);
+    m_shared.clear();
+    m_prefixes.clear();
+    for (int idx : cells) {
+        m_cells[idx].state = CellValue::S_UNVISITED;
+        m_cells[idx].value = Token();
+        m_stops[idx] = make_pair(-1, E_NONE);
+    }
+    sort(cells);
+    for (int idx : m_order) {
+        eval_cell(idx);
+    }
+}
+
+// moves the first n items of the cells out of v, the last n get value
+template <class T>
+static void shift_cells(vector<T> &v, const size_t n, const T &value) {
+    move(v.begin() + n, v.end(), v.begin());
+    fill(v.end() - n, v.end(), value);
+}
+
+// moves the rows up (see Stream): the cells keep their values, programs
+// and types, which is all the expressions of the rows filled out later
+// read from them; the references of the moved cells to the rows moved
+// out are never followed as the cells are evaluated
+void Tokenizer::shift_rows(const short rows) {
+    size_t n = static_cast<size_t>(rows) * m_cols;
+    shift_cells(m_cells, n, CellValue());
+    shift_cells(m_programs, n, static_cast<const Program*>(nullptr));
+    shift_cells(m_stops, n, make_pair(-1, E_NONE));
+    shift_cells(m_kinds, n, PK_OTHER);
+    shift_cells(m_types, n, VT_ANY);
+    shift_cells(m_numeric, n, static_cast<char>(0));
+    m_graph.build(m_programs);
+    m_native.clear();
+    m_shared.clear();
+    m_prefixes.clear();
+}
+
+// parses reference (e.g. A4) to the cell which is not an expression
+// returns false for malformed cell
+bool Tokenizer::parse_reference(const int idx) {
+    const string &s = m_table[idx / m_cols][idx % m_cols];
+    Token tok;
+
+    if (is_number(s) && m_int64) {
+        long long num;
+        if (!get_int64_by_str(s, num)) {
+            return false;
+        }
+        tok = num;
+    }
+    else if (is_number(s)) {
+        int num;
+        if (!get_int_by_str(s, num)) {
+            return false;
+        }
+        tok = num;
+    }
+    else if (is_string_literal(s)) {
+        tok = m_strings.intern(s.substr(1)); // removing leading "'"
+    }
+    else if (s.empty()) {
+        tok = STR_EMPTY;
+    }
+    else {
+        return false;
+    }
+
+    m_cells[idx].value = tok;
+    m_cells[idx].state = CellValue::S_DONE;
+
+    return true;
+}
+
+// calculates the product of two numeric operands
+// any other operand (including error) results in #E_UNEXP_EXPR;
+// the integers are not truncated, the result out of 64 bits gives
+// #E_OVERFLOW
+Token Tokenizer::evaluate(const Token &left, const Token &right,
+    const oper op) const {
+    if (left.type == Token::T_INTEGER && right.type == Token::T_INTEGER) {
+        long long res;
+        err_code err = apply_checked(op, left.i_value, right.i_value, res);
+        return (err == E_NONE) ? Token(res) : Token(err);
+    }
+    if (left.type != Token::T_NUMBER || right.type != Token::T_NUMBER) {
+        return Token(E_UNEXP_EXPR);
+    }
+
+    Token res = left;
+    switch (op) {
+    case OP_ADD: res.n_value += right.n_value;
+        break;
+    case OP_SUB: res.n_value -= right.n_value;
+        break;
+    case OP_MUL: res.n_value *= right.n_value;
+        break;
+    case OP_DIV: res.n_value /= right.n_value;
+        if (isinf(res.n_value)) { // detecting division by zero
+            return Token(E_INFINITE);
+        }
+        break;
+    default:
+        return Token(E_UNKNOWN_OP);
+    }
+    res.n_value = static_cast<int>(res.n_value);
+
+    return res;
+}
+
+// Runs the program compiled by Compiler::compile() on the fixed-size
+// operand stack. All the cells referenced by the program are already
+// evaluated (see sort()), the evaluation stops at the position
+// given by stop with its error. The first error stops the evaluation
+// and becomes the result.
+Token Tokenizer::execute(const Program &prog, const int base,
+    const pair<int, err_code> &stop, const size_t first,
+    const Token &operand) const {
+    Token stack[Program::MAX_STACK];
+    int sp = 0;
+    size_t end = (stop.first < 0) ? prog.m_code.size() : stop.first;
+    if (first > 0) {
+        stack[sp++] = operand;
+    }
+
+    for (size_t pc = first; pc < end; pc++) {
+        const Instr &in = prog.m_code[pc];
+        switch (in.code) {
+        case Instr::I_NUM:
+            stack[sp++] = m_int64 ? Token(static_cast<long long>(in.arg)) :
+                Token(in.arg);
+            break;
+        case Instr::I_REF:
+            stack[sp++] = m_cells[base + in.arg].value;
+            break;
+        case Instr::I_TOUCH:
+            break;
+        case Instr::I_OPER:
+            stack[0] = evaluate(stack[0], stack[1], static_cast<oper>(in.arg));
+            if (stack[0].type == Token::T_ERROR) {
+                return stack[0];
+            }
+            sp = 1;
+            break;
+        case Instr::I_ERROR:
+            return Token(static_cast<err_code>(in.arg));
+        case Instr::I_RESULT:
+            return m_cells[base + in.arg].value;
+        }
+    }
+    if (stop.first >= 0) {
+        return Token(stop.second);
+    }
+
+    // case when expression contains only one token (e.g. =1)
+    return (sp == 1) ? stack[0] : Token();
+}
+
+// Runs the program the way execute() does on the numbers only: all the
+// operands are known to be numbers (see infer_types()), so the operation
+// is applied without checking them
+Token Tokenizer::execute_numeric(const Program &prog, const int base) const {
+    double stack[Program::MAX_STACK];
+    int sp = 0;
+
+    for (const Instr &in : prog.m_code) {
+        switch (in.code) {
+        case Instr::I_NUM:
+            stack[sp++] = in.arg;
+            break;
+        case Instr::I_REF:
+            stack[sp++] = m_cells[base + in.arg].value.n_value;
+            break;
+        case Instr::I_OPER:
+            switch (in.arg) {
+            case OP_ADD: stack[0] += stack[1];
+                break;
+            case OP_SUB: stack[0] -= stack[1];
+                break;
+            case OP_MUL: stack[0] *= stack[1];
+                break;
+            case OP_DIV: stack[0] /= stack[1];
+                if (isinf(stack[0])) { // detecting division by zero
+                    return Token(E_INFINITE);
+                }
+                break;
+            default:
+                return Token(E_UNKNOWN_OP);
+            }
+            stack[0] = static_cast<int>(stack[0]);
+            sp = 1;
+            break;
+        default: // no other instructions in such programs
+            break;
+        }
+    }
+
+    return (sp == 1) ? Token(static_cast<int>(stack[0])) : Token();
+}
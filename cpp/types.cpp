@@ -0,0 +1,161 @@
+#include "eltab.h"
+
+// type of the value known from the token
+static value_type get_type(const Token &tok) {
+    switch (tok.type) {
+    case Token::T_NUMBER:
+    case Token::T_INTEGER:
+        return VT_NUMBER;
+    case Token::T_STRING:
+        return VT_STRING;
+    case Token::T_ERROR:
+        return VT_ERROR;
+    default:
+        return VT_ANY;
+    }
+}
+
+// returns the kind of the program: it is of the form x0 op1 x1 op2 x2 ...
+// (see Compiler::compile()) which may fail on numbers only if it divides
+// by the operand which is not a nonzero number
+program_kind get_program_kind(const Program &prog) {
+    const vector<Instr> &code = prog.m_code;
+    program_kind kind = PK_SAFE;
+    int sp = 0;
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        const Instr &in = code[pc];
+        if (in.code == Instr::I_NUM || in.code == Instr::I_REF) {
+            sp++;
+        }
+        else if (in.code == Instr::I_OPER && sp == 2 && in.arg >= OP_ADD &&
+            in.arg <= OP_DIV) {
+            if (in.arg == OP_DIV && (code[pc - 1].code != Instr::I_NUM ||
+                code[pc - 1].arg == 0)) {
+                kind = PK_MAY_FAIL;
+            }
+            sp = 1;
+        }
+        else {
+            return PK_OTHER;
+        }
+    }
+    return (sp == 1) ? kind : PK_OTHER;
+}
+
+// Works out at load time the type of the value of the expression put in
+// order by sort(), the types of the cells it references are already
+// known: the cells which are not expressions have their values parsed,
+// the expressions put in order before have their types (see m_types) and
+// the other ones have their values.
+// The program is run on the types instead of the values. The operation
+// on the numbers gives a number unless it may fail: the division by the
+// operand which is not a nonzero number or any operation in the integer
+// mode (overflow). The operation on the string or the error gives
+// E_UNEXP_EXPR, and if no operation before it may fail, that is the
+// value of the expression; the same goes for the error it stops with.
+// Such expression gets its value here and is not put in order, except
+// with --compile: the compiled sheet is used for the tables with other
+// values of the cells, so the expression is evaluated as usual.
+// The expression which references only the numbers is evaluated without
+// checking the types of the operands (see execute_numeric()); the usual
+// one of such kind (see get_program_kind()) is not run on the types.
+bool Tokenizer::infer_type(const int idx) {
+    auto get_ref_type = [&](const int cell) {
+        const Token &tok = m_cells[cell].value;
+        return (m_programs[cell] != nullptr &&
+            tok.type == Token::T_UNDEFINED) ? m_types[cell] : get_type(tok);
+    };
+
+    if (m_kinds[idx] != PK_OTHER && m_stops[idx].first < 0 && !m_int64) {
+        bool numbers = true;
+        for (const int *dep = m_graph.deps_begin(idx);
+            dep < m_graph.deps_end(idx) && numbers; ++dep) {
+            numbers = get_ref_type(*dep) == VT_NUMBER;
+        }
+        if (numbers) {
+            m_types[idx] = (m_kinds[idx] == PK_SAFE) ? VT_NUMBER : VT_ANY;
+            m_numeric[idx] = 1;
+            m_numeric_cells++;
+            return false;
+        }
+    }
+
+    const vector<Instr> &code = m_programs[idx]->m_code;
+    const pair<int, err_code> &stop = m_stops[idx];
+    size_t end = (stop.first < 0) ? code.size() : stop.first;
+
+    value_type stack[Program::MAX_STACK];
+    bool nonzero[Program::MAX_STACK]; // the operand is nonzero number
+    int sp = 0;
+    bool may_fail = false;      // some operation before may give an error
+    bool numeric = stop.first < 0 && !m_int64;
+    bool done = false;          // the value is known without the rest
+    value_type result = VT_ANY;
+    err_code error = E_NONE;    // the error known to be the value
+
+    // the expression results in the error, the known one unless some
+    // operation before may fail
+    auto fail = [&](const err_code code) {
+        result = VT_ERROR;
+        error = may_fail ? E_NONE : code;
+        done = true;
+    };
+
+    for (size_t pc = 0; pc < end && !done; pc++) {
+        const Instr &in = code[pc];
+        switch (in.code) {
+        case Instr::I_NUM:
+            stack[sp] = VT_NUMBER;
+            nonzero[sp++] = in.arg != 0;
+            break;
+        case Instr::I_REF:
+            stack[sp] = get_ref_type(idx + in.arg);
+            numeric = numeric && stack[sp] == VT_NUMBER;
+            nonzero[sp++] = false;
+            break;
+        case Instr::I_TOUCH:
+            break;
+        case Instr::I_OPER:
+            if (stack[0] == VT_STRING || stack[0] == VT_ERROR ||
+                stack[1] == VT_STRING || stack[1] == VT_ERROR) {
+                fail(E_UNEXP_EXPR);
+                break;
+            }
+            may_fail = may_fail || m_int64 ||
+                stack[0] != VT_NUMBER || stack[1] != VT_NUMBER ||
+                (in.arg == OP_DIV && !nonzero[1]);
+            stack[0] = VT_NUMBER;
+            nonzero[0] = false;
+            sp = 1;
+            break;
+        case Instr::I_ERROR:
+            fail(static_cast<err_code>(in.arg));
+            break;
+        case Instr::I_RESULT:
+            result = get_ref_type(idx + in.arg);
+            if (may_fail && result != VT_ERROR) {
+                result = VT_ANY;
+            }
+            numeric = false;
+            done = true;
+            break;
+        }
+    }
+    if (!done && stop.first >= 0) {
+        fail(stop.second);
+    }
+    else if (!done) {
+        result = (sp != 1) ? VT_ANY :
+            (may_fail && stack[0] != VT_ERROR) ? VT_ANY : stack[0];
+    }
+
+    m_types[idx] = result;
+    m_numeric[idx] = numeric && result != VT_ERROR;
+    m_numeric_cells += m_numeric[idx];
+    if (error != E_NONE && m_resolve) {
+        m_cells[idx].value = Token(error);
+        m_resolved_cells++;
+        return true;
+    }
+    return false;
+}
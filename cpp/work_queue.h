@@ -0,0 +1,43 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+
+using namespace std;
+
+// Double-ended queue of tasks (cell indices) owned by one worker.
+// The owner pushes and pops at the back (the most recent task, its inputs
+// are likely still in cache), the other workers steal from the front.
+class WorkQueue {
+    deque<int> m_tasks;
+    mutex m_mutex;
+
+public:
+    // adds the task, called by the owner
+    void push(const int task) {
+        lock_guard<mutex> lock(m_mutex);
+        m_tasks.push_back(task);
+    }
+
+    // takes the most recent task, called by the owner
+    bool pop(int &task) {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_tasks.empty()) {
+            return false;
+        }
+        task = m_tasks.back();
+        m_tasks.pop_back();
+        return true;
+    }
+
+    // takes the oldest task, called by other workers
+    bool steal(int &task) {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_tasks.empty()) {
+            return false;
+        }
+        task = m_tasks.front();
+        m_tasks.pop_front();
+        return true;
+    }
+};